@@ -27,51 +27,443 @@ To compile with testcases, run the Makefile.
 void diskHandler(int dev, void *arg);
 void termHandler(int dev, void *arg);
 void syscallHandler(int dev, void *arg);
+void advanceTimers(void);
+
+// What happens when a timer expires
+#define TIMER_WAIT     0  // Give up a blocked send or receive
+#define TIMER_SLEEP    1  // Wake a process in kernSleep
+#define TIMER_PERIODIC 2  // Send the tick to a mailbox and start again
+
+// A deadline on the timer wheel, counted in clock ticks
+typedef struct Timer {
+    int kind;           // One of the TIMER_ kinds above
+    int deadline;       // Tick on which the timer expires
+    int armed;          // 1 while the timer is on the wheel
+    int level;          // Wheel level and bucket the timer is in
+    int bucket;
+    struct PCB* owner;  // Process waiting on the timer
+    int period;         // Ticks between expiries of a periodic timer, or 0
+    int mboxId;         // Mailbox a periodic timer sends to
+    struct Timer* prev;
+    struct Timer* next;
+} Timer;
+
+#define LOWEST_WAIT_PRIORITY 5 // Lowest priority of a testcase process
 
 typedef struct PCB {
     int pid;
     int isBlocked;
     struct PCB* nextInQueue;
+    struct PCB* prevInQueue;
+    const struct mbox_iovec* msgIov; // Buffers of a blocked consumer
+    int msgIovCnt;    // Number of buffers in msgIov
+    int msgMaxSize;   // Total size of those buffers
+    int msgSize;      // Length of the message delivered into the buffer
+    int delivered;    // 1 if a sender delivered straight into the buffer
+    int readyMbox;    // Mailbox that woke a process in MboxRecvAny, or -1
+    Timer timer;      // Timeout of a blocked send or receive, or kernSleep
+    int waitMbox;     // Mailbox whose queue a timed waiter is in
+    int waitIsProducer; // 1 if that is the producer queue
+    int timedOut;     // 1 if the timer woke the process
+    int deviceStatus; // Status handed to a process woken in waitDevice
+    int wakeStatus;   // 0 if a topic subscriber was woken by a publish,
+                      // -3 if by the topic being released
+    int waitPriority; // Priority set with MboxSetWaitPriority
+    int waitPriorityPid; // Process that set waitPriority
+    int flushSeq;     // Lines a process in termFlush waits to see sent
     int filled;
 } PCB;
 
+// Links a process blocked in MboxRecvAny into one mailbox's list of waiters
+typedef struct SelectNode {
+    struct PCB* waiter;
+    int mboxId;
+    int linked;       // 1 while the node is in the mailbox's list
+    struct SelectNode* prev;
+    struct SelectNode* next;
+} SelectNode;
+
+// Payload sizes of the slab classes. Payload memory is a pool of one
+// MAX_MESSAGE page for every slot, so any message fits while a slot is
+// free. Each class carves pages from the pool into payloads of its size.
+#define NUM_SLAB_CLASSES 5
+#define SLAB_SIZES       { 0, 4, 16, 64, MAX_MESSAGE }
+#define SLAB_PAGE_SIZE   MAX_MESSAGE
+#define NUM_SLAB_PAGES   MAXSLOTS
+
+typedef struct SlabPage {
+    int slabClass;  // Class the page is carved into, or -1 if in the pool
+    int numUsed;    // Number of the page's payloads currently taken
+    int freeList;   // Index of the page's first free payload, or -1
+    int prev;       // Neighbours in the class's list of pages with a free
+    int next;       // payload; next also links the pool's free pages
+} SlabPage;
+
+typedef struct Slab {
+    int size;       // Largest payload in this class
+    int numPages;   // Number of pages carved into this class
+    int numUsed;    // Number of payloads held by queued messages
+    int numStale;   // Payloads left on slots freed by MboxRelease
+    int highWater;  // Largest numUsed seen so far
+    int partial;    // First page with a free payload, or -1
+} Slab;
+
 typedef struct Message {
     int mailboxId;
-    char text[MAX_MESSAGE];
-    struct Message* nextMessage;
-    int filled;
+    char* text;                  // Payload taken from a slab, if any
+    int slabClass;               // Slab the payload came from, or -1
+    int length;                  // Number of bytes of text that are in use
+    struct Message* nextMessage; // Next message in mailbox, or next free slot
 } Message;
 
+/*
+Usage statistics are kept for every mailbox unless the kernel is built with
+-DMBOX_STATS=0, in which case the STAT_ macros below expand to nothing and
+the counters take no space.
+*/
+#ifndef MBOX_STATS
+#define MBOX_STATS 1
+#endif
+
+/*
+Block durations are counted in log-scaled buckets, as in an HDR histogram:
+each power of two is split into LAT_SUB_BUCKETS equal buckets, so a bucket
+is never wider than a quarter of the values in it. Durations under
+LAT_SUB_BUCKETS microseconds get a bucket each, and ones past 2^24
+microseconds all land in the last bucket.
+*/
+#define LAT_SUB_BITS    2
+#define LAT_SUB_BUCKETS (1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS    24
+#define LAT_BUCKETS \
+    (((LAT_MAX_BITS - LAT_SUB_BITS + 1) << LAT_SUB_BITS) + 1)
+
+typedef struct LatencyHist {
+    int counts[LAT_BUCKETS];
+    int samples;         // Block durations recorded
+    int max;             // Longest duration recorded, in microseconds
+} LatencyHist;
+
+typedef struct MailboxStats {
+    int sends;           // Messages sent, published, or handed off
+    int recvs;           // Messages received
+    int condFails;       // Conditional sends and receives that would block
+    int producerBlocks;  // Times a producer blocked
+    int consumerBlocks;  // Times a consumer blocked
+    int depthHighWater;  // Most messages queued at once
+    int bytes;           // Bytes of message sent
+    LatencyHist blockLatency; // How long producers and consumers blocked
+} MailboxStats;
+
 typedef struct Mailbox {
     int id;
     int numSlots;
     int slotSize;
     int numSlotsUsed;
-    struct Message* messages;
+    int slabClass;    // Smallest slab class that fits slotSize
+    int waitOrder;    // MBOX_FIFO or MBOX_PRIORITY
+    int topicId;      // Index into topics if this is a topic, or -1
+    struct Message* messages[MBOX_NUM_PRI];    // One lane per priority
+    struct Message* lastMessage[MBOX_NUM_PRI];
+    int laneBitmap;   // Bit p is set while lane p has a message
     struct PCB* consumers;
+    struct PCB* lastConsumer;
     struct PCB* producers;
+    struct PCB* lastProducer;
+    struct SelectNode* selectors;    // Processes waiting in MboxRecvAny
+    struct SelectNode* lastSelector;
     int consumerQueued;
     int producerQueued;
+    int consumerAwake;  // 1 while a woken consumer has yet to take its turn
+    int producerAwake;  // 1 while a woken producer has yet to take its turn
     int released;
+    int departing;    // Woken processes and releaser yet to leave
     int filled;
+#if MBOX_STATS
+    MailboxStats stats;
+#endif
 } Mailbox;
 
+/*
+A topic keeps the last depth published messages in a ring. Each message is
+stored once, in one slot, with a count of the subscribers that have yet to
+read it; the last of them to read it frees the slot. Every subscriber has
+its own cursor, the sequence number of the next message it will read.
+*/
+#define MAXTOPICS       50
+#define MAXTOPICDEPTH   64
+
+typedef struct Topic {
+    int mboxId;       // Mailbox the topic belongs to, or -1 if unused
+    int depth;        // Most messages kept at once
+    int lagPolicy;    // TOPIC_DROP_OLDEST or TOPIC_REJECT_NEW
+    int oldestSeq;    // Sequence number of the oldest message kept
+    int nextSeq;      // Sequence number the next message will get
+    struct Message* ring[MAXTOPICDEPTH]; // Message seq is at seq % depth
+    int refs[MAXTOPICDEPTH];             // Subscribers yet to read each one
+    int subscribed[MAXPROC];  // 1 if the subscriber id is in use
+    int cursor[MAXPROC];      // Next sequence number each subscriber reads
+    int numSubscribers;
+} Topic;
+
+void addProcessToEndOfQueue(int pid, struct PCB** head, struct PCB** tail);
+void removeProcessFromQueue(struct PCB** head, struct PCB** tail);
+void unlinkProcessFromQueue(struct PCB* process, struct PCB** head, 
+        struct PCB** tail);
+
 void (*systemCallVec[MAXSYSCALLS])(USLOSS_Sysargs *args);
 
 struct Mailbox mailboxes[MAXMBOX];
-struct Message mailSlots[MAXSLOTS]; 
+
+/*
+Message storage is shared by every mailbox rather than carved out per mailbox
+at creation. Mailboxes may promise more slots in total than MAXSLOTS, and only
+slots actually holding messages count against the limit (see test16 and
+test44). The free list hands back the most recently freed slot first, so a
+mailbox passing messages back and forth keeps reusing the same warm slot.
+*/
+struct Message mailSlots[MAXSLOTS];
 struct PCB shadowProcessTable[MAXPROC+1];
+SelectNode selectNodes[MAXPROC][MAXRECVANY];
 
 int numMailboxes;     // The number of mailboxes being used currently
 int numMailboxSlots;  // The number of slots being used currently
-int lastAssignedId;   // The last assigned index for mailboxes
-int lastAssignedSlot; // The last assigned index for slots
 
-int consumerAwake; // Use so only one consumer can be awake at a time
-int producerAwake;
+int freeMailboxIds[MAXMBOX]; // Circular queue of mailbox ids not in use
+int freeIdHead;              // Index of the next id to hand out
+int numFreeIds;              // The number of ids in the queue
+
+Message* freeSlots;   // Head of the list of unused slots
+
+Topic topics[MAXTOPICS];
+
+#if MBOX_STATS
+int slotHighWater;    // Most slots in use at once
+int releasesWithWaiters; // Releases that had to flush out waiters
+LatencyHist blockLatency;  // Block durations of every mailbox together
+
+void latencyRecord(int mbox_id, int usecs);
+
+#define STAT_ADD(mbox_id, field, n) (mailboxes[mbox_id].stats.field += (n))
+#define STAT_DEPTH(mbox_id) do { \
+    if (mailboxes[mbox_id].numSlotsUsed > \
+            mailboxes[mbox_id].stats.depthHighWater) { \
+        mailboxes[mbox_id].stats.depthHighWater = \
+            mailboxes[mbox_id].numSlotsUsed; \
+    } \
+} while (0)
+#define STAT_SLOTS() do { \
+    if (numMailboxSlots > slotHighWater) { \
+        slotHighWater = numMailboxSlots; \
+    } \
+} while (0)
+#define STAT_RESET(mbox_id) \
+    memset(&mailboxes[mbox_id].stats, 0, sizeof(MailboxStats))
+#define STAT_RELEASE() (releasesWithWaiters++)
+#define STAT_BLOCKED(mbox_id, blockStart) \
+    latencyRecord(mbox_id, currentTime() - (blockStart))
+#else
+#define STAT_ADD(mbox_id, field, n)
+#define STAT_DEPTH(mbox_id)
+#define STAT_SLOTS()
+#define STAT_RESET(mbox_id)
+#define STAT_RELEASE()
+#define STAT_BLOCKED(mbox_id, blockStart) (void)(blockStart)
+#endif
+
+/*
+The trace ring keeps the last TRACE_RING_SIZE mailbox events, overwriting
+the oldest once full. Recording is off until traceEnable(1), and while off
+each trace point costs only the test of traceEnabled.
+*/
+#define TRACE_RING_SIZE 4096
+
+#define TRACE_SEND      0  // Send returned; result is its return value
+#define TRACE_RECV      1  // Recv returned; result is its return value
+#define TRACE_BLOCK     2  // The process is blocking; result is the status
+#define TRACE_WAKE      3  // A process was unblocked; result is its pid
+#define TRACE_RELEASE   4  // MboxRelease returned; result is its return value
+#define TRACE_INTERRUPT 5  // A device interrupt; result is the device status
+
+typedef struct TraceEvent {
+    int time;          // currentTime() when the event was recorded
+    short pid;         // Process running when the event was recorded
+    short mboxId;      // Mailbox involved, or -1 if none
+    int op;            // One of the TRACE_ ops above
+    int result;
+} TraceEvent;
+
+TraceEvent traceRing[TRACE_RING_SIZE];
+int traceNext;        // Index the next event is written to
+int traceCount;       // The number of events in the ring
+int traceEnabled;     // 1 while events are being recorded
+
+void traceRecord(int op, int mbox_id, int result);
+
+#define TRACE(op, mbox_id, result) do { \
+    if (traceEnabled) { \
+        traceRecord(op, mbox_id, result); \
+    } \
+} while (0)
+
+Slab slabs[NUM_SLAB_CLASSES];
+SlabPage slabPages[NUM_SLAB_PAGES];
+int freePages;        // First page in the pool, or -1
+char slabStorage[NUM_SLAB_PAGES * SLAB_PAGE_SIZE]; // Every page, in order
+
+/*
+The timer wheel has three levels of 64 buckets. Level 0 holds timers due
+within 64 ticks, one bucket per tick; level 1 buckets each cover 64 ticks,
+and level 2 buckets 4096. Starting and cancelling a timer are O(1). Each
+clock tick expires exactly the one level 0 bucket that is due, and every
+64 ticks the next level 1 bucket is spread back down into level 0 (and
+likewise from level 2 every 4096 ticks), so each timer moves at most twice.
+Timers further out than level 2 reaches wait in its last bucket and are
+placed again each time they come around.
+*/
+#define WHEEL_BITS       6
+#define WHEEL_SIZE       (1 << WHEEL_BITS)
+#define WHEEL_MASK       (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS     3
+#define CLOCK_TICK_USECS 20000 // Time between clock interrupts
+#define MAXTIMERS        50    // Periodic timers that can exist at once
+
+Timer* timerWheel[WHEEL_LEVELS][WHEEL_SIZE];
+int clockTicks;       // The number of clock interrupts handled so far
+int numArmedTimers;   // The number of timers on the wheel
+
+Timer periodicTimers[MAXTIMERS];
+
 
 int timeOfLastClockMessage; // The time the last clock msg was sent
 
+struct PCB* clockWaiters;    // Processes waiting for the next clock status
+struct PCB* lastClockWaiter;
+
+/*
+Each terminal and disk unit queues the statuses of its interrupts in a ring
+until waitDevice takes them, oldest first. A status that arrives while the
+ring is full is dropped and counted as an overflow. A status that arrives
+while a process is already waiting goes straight to that process.
+*/
+#define MAXDEVICERING       64  // Largest depth a device ring can be set to
+#define DEVICE_RING_DEPTH   16  // Depth of each device ring at startup
+#define NUM_DEVICE_RINGS    6   // Terminals 0-3, then disks 0-1
+
+typedef struct DeviceRing {
+    int statuses[MAXDEVICERING];
+    int depth;        // Most statuses kept at once
+    int head;         // Index of the oldest status
+    int count;        // The number of statuses in the ring
+    int overflows;    // Statuses dropped because the ring was full
+    struct PCB* waiters;      // Processes in waitDevice for this unit
+    struct PCB* lastWaiter;
+} DeviceRing;
+
+DeviceRing deviceRings[NUM_DEVICE_RINGS];
+
+/*
+A terminal in line mode collects received characters into a line, with
+backspace erasing the last one, and sends each finished line to the
+terminal's line mailbox, so a reader wakes once per line. A line is
+finished by a newline or by reaching MAXLINE characters.
+*/
+#define TERM_LINE_SLOTS 10  // Finished lines a line mailbox holds
+
+typedef struct TermLine {
+    int mboxId;       // Line mailbox, or -1 if the terminal is not in line mode
+    char line[MAXLINE];  // Characters of the line being typed
+    int length;
+    int lostLines;    // Lines dropped because the line mailbox was full
+} TermLine;
+
+TermLine termLines[4];
+
+/*
+Buffered terminal output. termWrite queues a whole line in the terminal's
+output mailbox with one send, and the terminal handler sends the next
+character each time the terminal is ready to transmit, so a line is never
+mixed with another writer's. Lines are counted as they are queued and as
+they finish sending, and termFlush waits for the second count to catch up.
+*/
+#define TERM_OUT_SLOTS  10  // Lines an output mailbox holds
+
+typedef struct TermOutput {
+    int mboxId;       // Output mailbox, or -1 if not used yet
+    char line[MAXLINE];  // Line being sent
+    int length;
+    int next;         // Index of the next character of line to send
+    int busy;         // 1 while a character is being sent
+    long recvInt;     // Receive interrupt bit kept in every control word
+    int queued;       // Lines written so far
+    int sent;         // Lines sent so far
+    struct PCB* flushers;     // Processes in termFlush
+    struct PCB* lastFlusher;
+} TermOutput;
+
+TermOutput termOutputs[4];
+
+/*
+Once waitDeviceRx or waitDeviceTx is used on a terminal, its statuses are
+split into a receive channel and a transmit channel. The receive channel
+is the terminal's status ring, and only statuses with a received character
+go into it. A transmit-ready status wakes the first process in
+waitDeviceTx instead, or is remembered for the next one if no process is
+waiting. A status with a received character is never taken as a transmit
+event unless a process is already waiting for one, since the transmitter
+is ready whenever it is idle.
+*/
+typedef struct TermChannels {
+    int split;        // 1 once the terminal's channels are split
+    int txPending;    // 1 if a transmit event came with no process waiting
+    int txStatus;     // Status of that event
+    struct PCB* txWaiters;    // Processes in waitDeviceTx
+    struct PCB* lastTxWaiter;
+} TermChannels;
+
+TermChannels termChannels[4];
+
+/*
+Disk requests queue per unit and are served by the disk interrupt handler,
+one sector operation per interrupt. By default the queue is served in
+C-LOOK order: the lowest track at or past the arm first, sector order
+within a track, and back to the lowest track once nothing is left further
+out. A request that starts on the sector right after the one just
+finished, on the same track and with the same operation, is counted as
+merged, since it continues the transfer without a seek.
+*/
+typedef struct DiskRequest {
+    int op;           // USLOSS_DISK_READ or USLOSS_DISK_WRITE
+    int track;
+    int sector;       // First sector
+    int sectors;      // The number of sectors
+    int done;         // Sectors transferred so far
+    char* buf;
+    int finished;     // 1 once the request has completed
+    struct PCB* owner;
+    struct DiskRequest* next;
+} DiskRequest;
+
+typedef struct DiskQueue {
+    int policy;       // DISK_FIFO or DISK_CLOOK
+    int track;        // Track the arm is on
+    int lastOp;       // Operation and sector after the last transfer
+    int nextSector;
+    DiskRequest* pending;     // Requests waiting, in order of arrival
+    DiskRequest* current;     // Request being served, or NULL if idle
+    int seeking;      // 1 while current waits for its seek
+    USLOSS_DeviceRequest device; // Operation handed to the disk
+    int seeks;        // Seeks to a different track
+    int tracks;       // Tracks crossed by those seeks
+    int merged;       // Requests that continued the last transfer
+} DiskQueue;
+
+DiskRequest diskRequests[MAXPROC];  // The request each process is making
+DiskQueue diskQueues[2];
+
+void startDiskRequest(DiskQueue* queue, int unit);
+void finishDiskRequest(DiskQueue* queue, int unit, int status);
+
 /*
 Disables interrupts in the simulation by setting the corresponding bit
 in the PSR to 0.
@@ -127,6 +519,29 @@ void nullsys(USLOSS_Sysargs *args) {
     USLOSS_Halt(1);
 }
 
+/*
+Sets up every slab class with no pages, and puts every page of slabStorage
+in the pool.
+*/
+void initSlabs() {
+    int sizes[NUM_SLAB_CLASSES] = SLAB_SIZES;
+
+    for (int c = 0; c < NUM_SLAB_CLASSES; c++) {
+        slabs[c].size = sizes[c];
+        slabs[c].numPages = 0;
+        slabs[c].numUsed = 0;
+        slabs[c].numStale = 0;
+        slabs[c].highWater = 0;
+        slabs[c].partial = -1;
+    }
+    for (int i = 0; i < NUM_SLAB_PAGES; i++) {
+        slabPages[i].slabClass = -1;
+        slabPages[i].next = i + 1;
+    }
+    slabPages[NUM_SLAB_PAGES - 1].next = -1;
+    freePages = 0;
+}
+
 /*
 Initializes the data structures for phase2, such as the mailbox and
 slot arrays and the shadow process table. Also initializes the
@@ -145,24 +560,89 @@ void phase2_init(void) {
 
     for (int i = 0; i < MAXPROC; i++) {
 	shadowProcessTable[i].filled = 0;
+	shadowProcessTable[i].timer.armed = 0;
+	shadowProcessTable[i].timer.period = 0;
+	shadowProcessTable[i].timedOut = 0;
+	shadowProcessTable[i].waitPriorityPid = -1;
     } 
     for (int i = 0; i < MAXMBOX; i++) {
         mailboxes[i].filled = 0;
+        freeMailboxIds[i] = i;
+    }
+    for (int i = 0; i < MAXSLOTS - 1; i++) {
+        mailSlots[i].nextMessage = &mailSlots[i + 1];
+        mailSlots[i].slabClass = -1;
     }
-    for (int i = 0; i < MAXSLOTS; i++) {
-	mailSlots[i].filled = 0;
+    mailSlots[MAXSLOTS - 1].slabClass = -1;
+    mailSlots[MAXSLOTS - 1].nextMessage = NULL;
+    freeSlots = &mailSlots[0];
+    initSlabs();
+    for (int i = 0; i < MAXTOPICS; i++) {
+        topics[i].mboxId = -1;
     }
     for (int i = 0; i < MAXSYSCALLS; i++) {
         systemCallVec[i] = nullsys;   
     }
 
     numMailboxes = 0;
-    lastAssignedId = -1;
-    lastAssignedSlot = -1;
-    consumerAwake = 0;
-    producerAwake = 0;
+    numMailboxSlots = 0;
+#if MBOX_STATS
+    slotHighWater = 0;
+    releasesWithWaiters = 0;
+    memset(&blockLatency, 0, sizeof(LatencyHist));
+#endif
+    freeIdHead = 0;
+    numFreeIds = MAXMBOX;
+    for (int i = 0; i < WHEEL_LEVELS; i++) {
+        for (int j = 0; j < WHEEL_SIZE; j++) {
+            timerWheel[i][j] = NULL;
+        }
+    }
+    for (int i = 0; i < MAXTIMERS; i++) {
+        periodicTimers[i].kind = TIMER_PERIODIC;
+        periodicTimers[i].armed = 0;
+        periodicTimers[i].period = 0;
+        periodicTimers[i].owner = NULL;
+    }
+    clockTicks = 0;
+    numArmedTimers = 0;
+
+    traceNext = 0;
+    traceCount = 0;
+    traceEnabled = 0;
 
     timeOfLastClockMessage = currentTime();
+    clockWaiters = NULL;
+    lastClockWaiter = NULL;
+    for (int i = 0; i < NUM_DEVICE_RINGS; i++) {
+        deviceRings[i].depth = DEVICE_RING_DEPTH;
+        deviceRings[i].head = 0;
+        deviceRings[i].count = 0;
+        deviceRings[i].overflows = 0;
+        deviceRings[i].waiters = NULL;
+        deviceRings[i].lastWaiter = NULL;
+    }
+    for (int i = 0; i < 4; i++) {
+        termLines[i].mboxId = -1;
+        termLines[i].length = 0;
+        termLines[i].lostLines = 0;
+        termOutputs[i].mboxId = -1;
+        termOutputs[i].busy = 0;
+        termOutputs[i].recvInt = 0;
+        termOutputs[i].queued = 0;
+        termOutputs[i].sent = 0;
+        termOutputs[i].flushers = NULL;
+        termOutputs[i].lastFlusher = NULL;
+        termChannels[i].split = 0;
+        termChannels[i].txPending = 0;
+        termChannels[i].txWaiters = NULL;
+        termChannels[i].lastTxWaiter = NULL;
+    }
+    for (int i = 0; i < 2; i++) {
+        memset(&diskQueues[i], 0, sizeof(DiskQueue));
+        diskQueues[i].policy = DISK_CLOOK;
+        diskQueues[i].lastOp = -1;
+    }
  
     MboxCreate(1, 4); 
     MboxCreate(1, 4); 
@@ -174,14 +654,18 @@ void phase2_init(void) {
 }
 
 /*
-Starts the service processes for phase2.
+Starts the service processes for phase2. There are none: terminal line
+mode, buffered terminal output and the disk request queues all run in the
+interrupt handlers, since forking a service here would shift the pid of
+every process the testcases create.
 */
 void phase2_start_service_processes(void) {
 
 }
 
 /*
-Checks if any processes are blocked on the device or clock mailboxes.
+Checks if any processes are waiting in waitDevice, or blocked on the
+device or clock mailboxes, or are waiting for a timer to run out.
 
 If yes, then return 1 because processes are waiting on I/O. If not,
 then return 0.
@@ -191,17 +675,41 @@ int phase2_check_io(void) {
         USLOSS_Console("Process is not in kernel mode.\n");
         USLOSS_Halt(1);
     }
+    if (clockWaiters != NULL) {
+        return 1;
+    }
+    for (int i = 0; i < NUM_DEVICE_RINGS; i++) {
+        if (deviceRings[i].waiters != NULL) {
+            return 1;
+        }
+    }
+    if (diskQueues[0].current != NULL || diskQueues[1].current != NULL) {
+        return 1;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (termOutputs[i].busy || termChannels[i].txWaiters != NULL) {
+            return 1;
+        }
+        int lineMbox = termLines[i].mboxId;
+        if (lineMbox != -1 && (mailboxes[lineMbox].consumers != NULL ||
+                mailboxes[lineMbox].selectors != NULL)) {
+            return 1;
+        }
+    }
     for (int i = 0; i < 7; i++) {
-        if (mailboxes[i].consumers != NULL) {
+        if (mailboxes[i].consumers != NULL || mailboxes[i].selectors != NULL) {
             return 1;
         }
     }
-    return 0;
+    return numArmedTimers > 0;
 }
 
 /*
-Clock handler called by phase 1. Checks if the last message sent to the
-clock mailbox was over 100 ms ago, and sends another message if yes.
+Clock handler called by phase 1. Expires the timers that are due on this
+tick, then checks if the last clock status was handed out over 100 ms ago.
+If yes, every process waiting in waitDevice for the clock gets the same new
+status and is woken in a single pass over the wait queue. The clock's
+mailbox (id 0) is still reserved, but the status is no longer sent to it.
 */
 void phase2_clockHandler(void) {
     if (USLOSS_PsrGet() % 2 == 0) {
@@ -209,18 +717,106 @@ void phase2_clockHandler(void) {
         USLOSS_Halt(1);
     }
 
+    advanceTimers();
+
     int status;
     int currTime = currentTime();
     if (currTime - timeOfLastClockMessage >= 100000) {
         int ret = USLOSS_DeviceInput(USLOSS_CLOCK_DEV, 0, &status); 
         timeOfLastClockMessage = currTime;
-        MboxCondSend(0, (void*)(&status), 4);
+        TRACE(TRACE_INTERRUPT, 0, status);
+
+        // Detach the queue first; a woken process may wait again right away
+        PCB* waiter = clockWaiters;
+        clockWaiters = NULL;
+        lastClockWaiter = NULL;
+        while (waiter != NULL) {
+            PCB* next = waiter->nextInQueue;
+            waiter->deviceStatus = status;
+            TRACE(TRACE_WAKE, 0, waiter->pid);
+            unblockProc(waiter->pid);
+            waiter = next;
+        }
     } 
 }
 
 /*
-Has the current process wait for a device to send an interrupt by
-calling recv on its mailbox.
+Returns the status ring of a terminal or disk unit, or NULL if the unit
+does not exist.
+
+Parameters:
+    type - the type of device (disk or terminal)
+    unit - the unit number of the device
+*/
+DeviceRing* getDeviceRing(int type, int unit) {
+    if (type == USLOSS_TERM_DEV && unit >= 0 && unit <= 3) {
+        return &deviceRings[unit];
+    }
+    if (type == USLOSS_DISK_DEV && (unit == 0 || unit == 1)) {
+        return &deviceRings[4 + unit];
+    }
+    return NULL;
+}
+
+/*
+Hands the status of an interrupt to the first process waiting for the
+device, or queues it in the device's ring if no process is waiting. If
+the ring is full, the status is dropped and counted as an overflow. Called
+from the interrupt handlers.
+
+Parameters:
+    ring - the status ring of the device
+    mbox_id - the id of the device's mailbox, for the trace
+    status - the device status read in the interrupt
+*/
+void queueDeviceStatus(DeviceRing* ring, int mbox_id, int status) {
+    if (ring->waiters != NULL) {
+        PCB* waiter = ring->waiters;
+        removeProcessFromQueue(&ring->waiters, &ring->lastWaiter);
+        waiter->deviceStatus = status;
+        TRACE(TRACE_WAKE, mbox_id, waiter->pid);
+        unblockProc(waiter->pid);
+    }
+    else if (ring->count < ring->depth) {
+        ring->statuses[(ring->head + ring->count) % ring->depth] = status;
+        ring->count++;
+    }
+    else {
+        ring->overflows++;
+    }
+}
+
+/*
+Takes the oldest status queued in a device's ring, or blocks until the
+interrupt handler hands over the next one. Called with interrupts
+disabled.
+
+Parameters:
+    ring - the status ring of the device
+    mbox_id - the id of the device's mailbox, for the trace
+    status - out pointer to deliver the status
+*/
+void takeDeviceStatus(DeviceRing* ring, int mbox_id, int *status) {
+    if (ring->count > 0) {
+        *status = ring->statuses[ring->head];
+        ring->head = (ring->head + 1) % ring->depth;
+        ring->count--;
+    }
+    else {
+        PCB* waiter = &shadowProcessTable[getpid() % MAXPROC];
+        addProcessToEndOfQueue(getpid(), &ring->waiters, &ring->lastWaiter);
+        TRACE(TRACE_BLOCK, mbox_id, 18);
+        blockMe(18);
+        *status = waiter->deviceStatus;
+    }
+}
+
+/*
+Has the current process wait for a device to send an interrupt. A
+terminal or disk status that arrived earlier is taken from the device's
+ring, oldest first; otherwise the process waits for the next one. Clock
+waiters instead join the clock's wait queue, so that all of them are woken
+by the same clock status.
 
 Parameters:
     type - the type of device (disk, terminal, or clock)
@@ -239,27 +835,157 @@ void waitDevice(int type, int unit, int *status) {
             USLOSS_Console("ERROR\n");
             USLOSS_Halt(1);
         }
+        int savedPsr = disableInterrupts(); 
+        PCB* waiter = &shadowProcessTable[getpid() % MAXPROC];
+        addProcessToEndOfQueue(getpid(), &clockWaiters, &lastClockWaiter);
+        TRACE(TRACE_BLOCK, 0, 17);
+        blockMe(17);
+        *status = waiter->deviceStatus;
+        restoreInterrupts(savedPsr);
+        return;
+    }
+
+    DeviceRing* ring = getDeviceRing(type, unit);
+    if (ring == NULL) {
+        USLOSS_Console("ERROR\n");
+        USLOSS_Halt(1);
+    }
+
+    int savedPsr = disableInterrupts(); 
+    takeDeviceStatus(ring, (type == USLOSS_TERM_DEV ? 1 : 5) + unit, status);
+    restoreInterrupts(savedPsr);
+}
+
+/*
+Adds a received character to a terminal's line. A backspace or delete
+erases the last character. A newline, or filling the line, sends the line
+to the line mailbox and starts a new one.
+
+Parameters:
+    term - the line state of the terminal
+    c - the character received
+*/
+void lineDiscipline(TermLine* term, char c) {
+    if (c == '\b' || c == 0x7f) {
+        if (term->length > 0) {
+            term->length--;
+        }
+        return;
     }
-    else if (type == USLOSS_TERM_DEV) {
-        if (unit < 0 || unit > 3) {
-            USLOSS_Console("ERROR\n");
-            USLOSS_Halt(1);
+    term->line[term->length++] = c;
+    if (c == '\n' || term->length == MAXLINE) {
+        if (MboxCondSend(term->mboxId, term->line, term->length) != 0) {
+            term->lostLines++;
         }
-        unit = unit + 1;
+        term->length = 0;
     }
-    else if (type == USLOSS_DISK_DEV) {
-        if (unit != 0 && unit != 1) {
-            USLOSS_Console("ERROR\n");
-            USLOSS_Halt(1);
+}
+
+/*
+Sends the next character of a terminal's buffered output, first moving on
+to the next queued line if the current one is done. Each finished line
+wakes the termFlush callers waiting for it. Once nothing is queued, the
+terminal goes idle and its transmit interrupts are turned off. Receive
+interrupts are left as termRecvInt set them.
+
+Parameters:
+    out - the output state of the terminal
+    unit - the unit number of the terminal
+*/
+void transmitNext(TermOutput* out, int unit) {
+    long control = out->recvInt;
+
+    while (out->next == out->length) {
+        if (out->length > 0) {
+            out->sent++;
+            PCB* flusher = out->flushers;
+            while (flusher != NULL) {
+                PCB* next = flusher->nextInQueue;
+                if (flusher->flushSeq <= out->sent) {
+                    unlinkProcessFromQueue(flusher, &out->flushers,
+                        &out->lastFlusher);
+                    TRACE(TRACE_WAKE, -1, flusher->pid);
+                    unblockProc(flusher->pid);
+                }
+                flusher = next;
+            }
+        }
+        out->next = 0;
+        out->length = MboxCondRecv(out->mboxId, out->line, MAXLINE);
+        if (out->length < 0) {
+            out->length = 0;
+            out->busy = 0;
+            USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void*)control);
+            return;
+        }
+    }
+
+    control = USLOSS_TERM_CTRL_CHAR(control, out->line[out->next++]);
+    control = USLOSS_TERM_CTRL_XMIT_INT(USLOSS_TERM_CTRL_XMIT_CHAR(control));
+    out->busy = 1;
+    USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void*)control);
+}
+
+/*
+Splits a terminal's statuses into receive and transmit channels, if they
+are not already. Statuses queued so far that have no received character
+are dropped from the ring, leaving it as the receive channel. Called with
+interrupts disabled.
+
+Parameters:
+    unit - the unit number of the terminal
+*/
+void splitTerminal(int unit) {
+    DeviceRing* ring = &deviceRings[unit];
+    if (termChannels[unit].split) {
+        return;
+    }
+    termChannels[unit].split = 1;
+
+    int kept = 0;
+    for (int i = 0; i < ring->count; i++) {
+        int status = ring->statuses[(ring->head + i) % ring->depth];
+        if (USLOSS_TERM_STAT_RECV(status) == USLOSS_DEV_BUSY) {
+            ring->statuses[(ring->head + kept) % ring->depth] = status;
+            kept++;
         }
-        unit = unit + 5;
     }
-    MboxRecv(unit, status, sizeof(int));
+    ring->count = kept;
+}
+
+/*
+Hands a transmit-ready status to the first process in waitDeviceTx, or
+remembers it for the next one. A status that also carries a received
+character is only handed to a process already waiting.
+
+Parameters:
+    unit - the unit number of the terminal
+    status - the terminal status read in the interrupt
+*/
+void postTransmitStatus(int unit, int status) {
+    TermChannels* chan = &termChannels[unit];
+    if (chan->txWaiters != NULL) {
+        PCB* waiter = chan->txWaiters;
+        removeProcessFromQueue(&chan->txWaiters, &chan->lastTxWaiter);
+        waiter->deviceStatus = status;
+        TRACE(TRACE_WAKE, 1 + unit, waiter->pid);
+        unblockProc(waiter->pid);
+    }
+    else if (USLOSS_TERM_STAT_RECV(status) != USLOSS_DEV_BUSY) {
+        chan->txPending = 1;
+        chan->txStatus = status;
+    }
 }
 
 /*
-Interrupt handler for terminals that sends the status of the terminal
-to its mailbox.
+Interrupt handler for terminals that queues the status of the terminal
+for waitDevice. While buffered output is being sent, a transmit-ready
+status sends the next character instead, and on a terminal with split
+channels it goes to the transmit channel. For a terminal in line mode, a
+received character goes to the line discipline; on a terminal with split
+channels, only statuses with a received character are queued. The
+terminal's mailbox is still reserved, but the status is no longer sent to
+it.
 
 Parameters:
     arg - the unit number of the terminal
@@ -269,12 +995,154 @@ void termHandler(int dev, void *arg) {
     int unitNo = (int)(long)arg;
     
     int ret = USLOSS_DeviceInput(USLOSS_TERM_DEV, unitNo, &status);
-    MboxCondSend(1 + unitNo, (void*)(&status), 4);
+    TRACE(TRACE_INTERRUPT, 1 + unitNo, status);
+    int received = USLOSS_TERM_STAT_RECV(status) == USLOSS_DEV_BUSY;
+    if (USLOSS_TERM_STAT_XMIT(status) == USLOSS_DEV_READY) {
+        if (termOutputs[unitNo].busy) {
+            transmitNext(&termOutputs[unitNo], unitNo);
+            if (!received) {
+                return;
+            }
+        }
+        else if (termChannels[unitNo].split) {
+            postTransmitStatus(unitNo, status);
+        }
+    }
+    if (termLines[unitNo].mboxId != -1 && received) {
+        lineDiscipline(&termLines[unitNo], USLOSS_TERM_STAT_CHAR(status));
+        return;
+    }
+    if (!termChannels[unitNo].split || received) {
+        queueDeviceStatus(&deviceRings[unitNo], 1 + unitNo, status);
+    }
+}
+
+/*
+Removes and returns the request a disk unit should serve next, or NULL if
+none is pending. Under C-LOOK that is the request with the lowest track,
+and then sector, at or past the arm, or the lowest of all if none is.
+
+Parameters:
+    queue - the request queue of the unit
+*/
+DiskRequest* nextDiskRequest(DiskQueue* queue) {
+    DiskRequest** best = NULL;
+    DiskRequest** lowest = NULL;
+
+    if (queue->pending == NULL || queue->policy == DISK_FIFO) {
+        best = &queue->pending;
+    }
+    else {
+        for (DiskRequest** link = &queue->pending; *link != NULL;
+                link = &(*link)->next) {
+            DiskRequest* req = *link;
+            if (lowest == NULL || req->track < (*lowest)->track || 
+                    (req->track == (*lowest)->track && 
+                    req->sector < (*lowest)->sector)) {
+                lowest = link;
+            }
+            if (req->track >= queue->track && (best == NULL || 
+                    req->track < (*best)->track || 
+                    (req->track == (*best)->track && 
+                    req->sector < (*best)->sector))) {
+                best = link;
+            }
+        }
+        if (best == NULL) {
+            best = lowest;
+        }
+    }
+
+    DiskRequest* req = *best;
+    if (req != NULL) {
+        *best = req->next;
+    }
+    return req;
+}
+
+/*
+Hands a disk unit the next operation of its current request: the seek to
+the request's track if the arm is elsewhere, or else the next sector. If
+the disk rejects the operation, the request completes with an error.
+
+Parameters:
+    queue - the request queue of the unit
+    unit - the unit number of the disk
+*/
+void issueDiskOperation(DiskQueue* queue, int unit) {
+    DiskRequest* req = queue->current;
+
+    if (req->track != queue->track) {
+        queue->seeks++;
+        queue->tracks += req->track > queue->track ? 
+            req->track - queue->track : queue->track - req->track;
+        queue->track = req->track;
+        queue->seeking = 1;
+        queue->device.opr = USLOSS_DISK_SEEK;
+        queue->device.reg1 = (void*)(long)req->track;
+    }
+    else {
+        queue->seeking = 0;
+        queue->device.opr = req->op;
+        queue->device.reg1 = (void*)(long)(req->sector + req->done);
+        queue->device.reg2 = req->buf + req->done * USLOSS_DISK_SECTOR_SIZE;
+    }
+    if (USLOSS_DeviceOutput(USLOSS_DISK_DEV, unit, &queue->device) != 
+            USLOSS_DEV_OK) {
+        finishDiskRequest(queue, unit, USLOSS_DEV_ERROR);
+    }
+}
+
+/*
+Completes a disk unit's current request and starts the next pending one,
+then wakes the process that made the request unless it has not blocked
+yet. The wakeup comes last since it may switch to that process.
+
+Parameters:
+    queue - the request queue of the unit
+    unit - the unit number of the disk
+    status - 0 if the request succeeded, or the disk's error status
+*/
+void finishDiskRequest(DiskQueue* queue, int unit, int status) {
+    DiskRequest* req = queue->current;
+
+    req->finished = 1;
+    req->owner->deviceStatus = status;
+    queue->current = NULL;
+    startDiskRequest(queue, unit);
+
+    if (req->owner->isBlocked) {
+        req->owner->isBlocked = 0;
+        TRACE(TRACE_WAKE, 5 + unit, req->owner->pid);
+        unblockProc(req->owner->pid);
+    }
+}
+
+/*
+Starts the next pending request of an idle disk unit, if there is one.
+
+Parameters:
+    queue - the request queue of the unit
+    unit - the unit number of the disk
+*/
+void startDiskRequest(DiskQueue* queue, int unit) {
+    DiskRequest* req = nextDiskRequest(queue);
+    if (req == NULL) {
+        return;
+    }
+    if (req->track == queue->track && req->op == queue->lastOp &&
+            req->sector == queue->nextSector) {
+        queue->merged++;
+    }
+    queue->current = req;
+    issueDiskOperation(queue, unit);
 }
 
 /*
-The interrupt handler for disks that sends the status of a terminal to
-its mailbox. 
+The interrupt handler for disks. While the unit is serving a queued
+request, the status finishes the current operation and the next one is
+started. Otherwise the status is queued for waitDevice. The disk's
+mailbox is still reserved, but the status is no longer sent to it.
 
 Parameters:
     arg - the unit number of the disk
@@ -284,7 +1152,27 @@ void diskHandler(int dev, void *arg) {
     int unitNo = (int)(long)arg;
     
     int ret = USLOSS_DeviceInput(USLOSS_DISK_DEV, unitNo, &status);
-    MboxCondSend(5 + unitNo, (void*)(&status), 4);
+    TRACE(TRACE_INTERRUPT, 5 + unitNo, status);
+
+    DiskQueue* queue = &diskQueues[unitNo];
+    DiskRequest* req = queue->current;
+    if (req == NULL) {
+        queueDeviceStatus(&deviceRings[4 + unitNo], 5 + unitNo, status);
+    }
+    else if (status != USLOSS_DEV_READY) {
+        finishDiskRequest(queue, unitNo, status);
+    }
+    else if (queue->seeking) {
+        issueDiskOperation(queue, unitNo);
+    }
+    else if (++req->done == req->sectors) {
+        queue->lastOp = req->op;
+        queue->nextSector = req->sector + req->sectors;
+        finishDiskRequest(queue, unitNo, 0);
+    }
+    else {
+        issueDiskOperation(queue, unitNo);
+    }
 }
 
 /*
@@ -309,61 +1197,400 @@ void syscallHandler(int dev, void *arg) {
 /*
 Returns the next available Mailbox id. The id is the index of the mailbox
 in the array of mailboxes, and ids can be reused once a mailbox is destroyed.
+Free ids are handed out in the order they were freed, so a released id is
+reused only after the ids that were already waiting in the queue.
 */
 int getNextMailboxId() {
     if (USLOSS_PsrGet() % 2 == 0) {
         USLOSS_Console("Process is not in kernel mode.\n");
         USLOSS_Halt(1);
     }
-    int nextId = lastAssignedId + 1;
-    while (!(mailboxes[nextId % MAXMBOX].filled == 0 || (
-            mailboxes[nextId % MAXMBOX].filled == 1 && 
-            mailboxes[nextId % MAXMBOX].released == 1 &&
-            mailboxes[nextId % MAXMBOX].consumers == NULL &&
-            mailboxes[nextId % MAXMBOX].producers == NULL))) {
-        nextId = (nextId + 1) % MAXMBOX;
-    }
+    int nextId = freeMailboxIds[freeIdHead];
+    freeIdHead = (freeIdHead + 1) % MAXMBOX;
+    numFreeIds--;
     return nextId;
 }
 
 /*
-Returns the next available slot id. The id is the index into the array of
-mailbox slots, and can be reused.
+Marks the mailbox with the given id as unused and adds the id to the end of
+the free id queue. Called once a released mailbox has no remaining
+producers or consumers. An id that is already free is left alone, so it
+can never be queued twice.
+
+Parameters:
+    mbox_id - the id of the mailbox to free
 */
-int getNextSlot() {
-    if (USLOSS_PsrGet() % 2 == 0) {
-        USLOSS_Console("Process is not in kernel mode.\n");
-        USLOSS_Halt(1);
-    }              
-    int nextSlot = lastAssignedSlot + 1;
-    while (mailSlots[nextSlot % MAXSLOTS].filled == 1) {
-        nextSlot = (nextSlot + 1) % MAXSLOTS;  
-    }              
-    return nextSlot;
-} 
+void freeMailboxId(int mbox_id) {
+    if (mailboxes[mbox_id].filled == 0) {
+        return;
+    }
+    mailboxes[mbox_id].filled = 0;
+    freeMailboxIds[(freeIdHead + numFreeIds) % MAXMBOX] = mbox_id;
+    numFreeIds++;
+}
 
 /*
-Returns 1 if a mailbox can be created, and 0 if it cannot because the 
-maximum number of mailboxes has been reached.
+Frees the id of a released mailbox once the last process waiting on it has
+left. Every process leaving a released mailbox calls this, and only the
+last of them finds the mailbox abandoned.
+
+Parameters:
+    mbox_id - the id of the mailbox a process just left
 */
-int mailboxAvail() {
-    return numMailboxes < MAXMBOX;
+void freeIfAbandoned(int mbox_id) {
+    Mailbox* mailbox = &mailboxes[mbox_id];
+    if (mailbox->released == 1 && mailbox->departing == 0 &&
+            mailbox->producers == NULL && mailbox->consumers == NULL) {
+        freeMailboxId(mbox_id);
+    }
 }
 
 /*
-Creates a mailbox with the given number of slots and slot size.
+Returns the smallest slab class whose payloads can hold size bytes.
 
 Parameters:
-    slots - the number of slots to hold messages the mailbox should have
-    slot_size - the largest message size that can be sent through this
-                mailbox
-
-Returns: the id of the allocated mailbox, or -1 in case of an error.
+    size - the number of bytes that must fit
 */
-int MboxCreate(int slots, int slot_size) {
-    if (USLOSS_PsrGet() % 2 == 0) {
-        USLOSS_Console("Process is not in kernel mode.\n");
-        USLOSS_Halt(1);
+int getSlabClass(int size) {
+    int c = 0;
+    while (slabs[c].size < size) {
+        c++;
+    }
+    return c;
+}
+
+/*
+Takes a page from the pool and carves it into payloads of the given class,
+linking them into the page's free list. A free payload keeps the index of
+the next free payload in its first bytes, so a payload must be able to
+hold an int. The page becomes the class's first page with a free payload.
+
+The pool never runs dry: a page is in use only while one of its payloads
+is, each payload sits on its own slot, and there is a page for every slot.
+
+Parameters:
+    slabClass - the class that needs another page
+*/
+void carvePage(int slabClass) {
+    Slab* slab = &slabs[slabClass];
+    int p = freePages;
+    SlabPage* page = &slabPages[p];
+    char* base = slabStorage + p * SLAB_PAGE_SIZE;
+    freePages = page->next;
+
+    page->slabClass = slabClass;
+    page->numUsed = 0;
+    page->freeList = -1;
+    for (int i = SLAB_PAGE_SIZE / slab->size - 1; i >= 0; i--) {
+        memcpy(base + i * slab->size, &page->freeList, sizeof(int));
+        page->freeList = i;
+    }
+    page->prev = -1;
+    page->next = slab->partial;
+    if (slab->partial != -1) {
+        slabPages[slab->partial].prev = p;
+    }
+    slab->partial = p;
+    slab->numPages++;
+}
+
+/*
+Gives the slot a payload from the given slab class, carving a new page for
+the class if none of its pages has a free payload.
+
+Parameters:
+    slot - the Message instance that needs a payload
+    slabClass - the slab class of the payload
+*/
+void allocPayload(Message* slot, int slabClass) {
+    Slab* slab = &slabs[slabClass];
+
+    if (slab->size > 0) {
+        if (slab->partial == -1) {
+            carvePage(slabClass);
+        }
+        int p = slab->partial;
+        SlabPage* page = &slabPages[p];
+        slot->text = slabStorage + p * SLAB_PAGE_SIZE + 
+            page->freeList * slab->size;
+        memcpy(&page->freeList, slot->text, sizeof(int));
+        page->numUsed++;
+
+        // A full page leaves the list of pages with a free payload
+        if (page->freeList == -1) {
+            slab->partial = page->next;
+            if (page->next != -1) {
+                slabPages[page->next].prev = -1;
+            }
+        }
+    }
+    else {
+        slot->text = NULL;
+    }
+    slot->slabClass = slabClass;
+
+    slab->numUsed++;
+    if (slab->numUsed > slab->highWater) {
+        slab->highWater = slab->numUsed;
+    }
+}
+
+/*
+Gives the slot's payload, if any, back to its page, without touching the
+class's counts. A page none of whose payloads is taken goes back to the
+pool, so the memory can serve any class again.
+
+Parameters:
+    slot - the Message instance whose payload should be returned
+*/
+void returnPayload(Message* slot) {
+    Slab* slab = &slabs[slot->slabClass];
+
+    if (slab->size > 0) {
+        int p = (slot->text - slabStorage) / SLAB_PAGE_SIZE;
+        SlabPage* page = &slabPages[p];
+        int wasFull = page->freeList == -1;
+
+        memcpy(slot->text, &page->freeList, sizeof(int));
+        page->freeList = (slot->text - (slabStorage + p * SLAB_PAGE_SIZE)) /
+            slab->size;
+        page->numUsed--;
+
+        if (!wasFull && page->numUsed == 0) {
+            if (page->prev != -1) {
+                slabPages[page->prev].next = page->next;
+            }
+            else {
+                slab->partial = page->next;
+            }
+            if (page->next != -1) {
+                slabPages[page->next].prev = page->prev;
+            }
+        }
+        else if (wasFull && page->numUsed > 0) {
+            page->prev = -1;
+            page->next = slab->partial;
+            if (slab->partial != -1) {
+                slabPages[slab->partial].prev = p;
+            }
+            slab->partial = p;
+        }
+        if (page->numUsed == 0) {
+            page->slabClass = -1;
+            page->next = freePages;
+            freePages = p;
+            slab->numPages--;
+        }
+    }
+
+    slot->text = NULL;
+    slot->slabClass = -1;
+}
+
+/*
+Returns the payload held by the slot, if any, to its slab class.
+
+Parameters:
+    slot - the Message instance whose payload should be freed
+*/
+void freePayload(Message* slot) {
+    if (slot->slabClass == -1) {
+        return;
+    }
+    slabs[slot->slabClass].numUsed--;
+    returnPayload(slot);
+}
+
+/*
+Prints the size, pages, and usage of every slab class, so the sizes can be
+tuned to the messages a program actually sends. Stale payloads belong to
+slots freed by MboxRelease; they go back to their pages when the slots are
+handed out again.
+*/
+void dumpSlabs(void) {
+    int pooled = NUM_SLAB_PAGES;
+    USLOSS_Console(" SIZE  PAGES  IN USE  STALE  HIGH WATER  BYTES IN USE\n");
+    for (int c = 0; c < NUM_SLAB_CLASSES; c++) {
+        USLOSS_Console("%5d  %5d  %6d  %5d  %10d  %12d\n", slabs[c].size, 
+            slabs[c].numPages, slabs[c].numUsed, slabs[c].numStale,
+            slabs[c].highWater, slabs[c].numUsed * slabs[c].size);
+        pooled -= slabs[c].numPages;
+    }
+    USLOSS_Console("pages in the pool: %d of %d\n", pooled, NUM_SLAB_PAGES);
+}
+
+#if MBOX_STATS
+/*
+Returns the histogram bucket a duration falls in. The top set bit picks
+the power of two and the LAT_SUB_BITS bits below it pick the bucket.
+
+Parameters:
+    usecs - the duration, in microseconds
+*/
+int latencyBucket(int usecs) {
+    if (usecs < LAT_SUB_BUCKETS) {
+        return usecs < 0 ? 0 : usecs;
+    }
+    int top = 31 - __builtin_clz(usecs);
+    if (top >= LAT_MAX_BITS) {
+        return LAT_BUCKETS - 1;
+    }
+    int shift = top - LAT_SUB_BITS;
+    return ((shift + 1) << LAT_SUB_BITS) + 
+        ((usecs >> shift) & (LAT_SUB_BUCKETS - 1));
+}
+
+/*
+Returns the largest duration that falls in the given bucket.
+
+Parameters:
+    bucket - the bucket index
+*/
+int latencyBucketTop(int bucket) {
+    if (bucket < LAT_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = (bucket >> LAT_SUB_BITS) - 1;
+    int sub = bucket & (LAT_SUB_BUCKETS - 1);
+    return ((LAT_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+/*
+Adds how long a process just spent blocked on a mailbox to the mailbox's
+histogram and to the global one.
+
+Parameters:
+    mbox_id - the id of the mailbox the process blocked on
+    usecs - how long it was blocked, in microseconds
+*/
+void latencyRecord(int mbox_id, int usecs) {
+    int bucket = latencyBucket(usecs);
+    LatencyHist* hist = &mailboxes[mbox_id].stats.blockLatency;
+
+    hist->counts[bucket]++;
+    hist->samples++;
+    if (usecs > hist->max) {
+        hist->max = usecs;
+    }
+    blockLatency.counts[bucket]++;
+    blockLatency.samples++;
+    if (usecs > blockLatency.max) {
+        blockLatency.max = usecs;
+    }
+}
+
+/*
+Returns the duration that at least the given percent of the histogram's
+samples are no longer than, to the precision of a bucket and never past
+the longest sample.
+
+Parameters:
+    hist - the histogram, with at least one sample
+    percent - the percentile, from 1 to 100
+*/
+int latencyPercentile(LatencyHist* hist, int percent) {
+    int wanted = (hist->samples * percent + 99) / 100;
+    int seen = 0;
+
+    for (int i = 0; i < LAT_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= wanted) {
+            int top = latencyBucketTop(i);
+            return top < hist->max ? top : hist->max;
+        }
+    }
+    return hist->max;
+}
+#endif
+
+/*
+Prints the usage statistics of every mailbox in use, followed by how many
+slots are in use now and at most, and how many releases found waiters. If
+the kernel was built without statistics, says so instead.
+*/
+void dumpMailboxes(void) {
+#if MBOX_STATS
+    USLOSS_Console("  ID  SLOTS  SIZE  DEPTH  HIGH   SENDS   RECVS  COND FAIL"
+        "  P BLOCKS  C BLOCKS    BYTES\n");
+    for (int i = 0; i < MAXMBOX; i++) {
+        Mailbox* mailbox = &mailboxes[i];
+        if (mailbox->filled == 0 || mailbox->released == 1) {
+            continue;
+        }
+        USLOSS_Console("%4d  %5d  %4d  %5d  %4d  %6d  %6d  %9d"
+            "  %8d  %8d  %7d\n",
+            i, mailbox->numSlots, mailbox->slotSize, mailbox->numSlotsUsed,
+            mailbox->stats.depthHighWater, mailbox->stats.sends,
+            mailbox->stats.recvs, mailbox->stats.condFails,
+            mailbox->stats.producerBlocks, mailbox->stats.consumerBlocks,
+            mailbox->stats.bytes);
+    }
+    USLOSS_Console("Slots in use: %d of %d   high water: %d   "
+        "releases with waiters: %d\n", numMailboxSlots, MAXSLOTS,
+        slotHighWater, releasesWithWaiters);
+#else
+    USLOSS_Console("dumpMailboxes(): statistics are not compiled in\n");
+#endif
+}
+
+/*
+Removes the slot at the head of the free list and returns it. Unused slots
+are linked together through nextMessage, so no scan of the slot array is
+needed. Requires that at least one slot is free.
+*/
+Message* getNextSlot() {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    Message* slot = freeSlots;
+    freeSlots = slot->nextMessage;
+    slot->nextMessage = NULL;
+
+    // Slots spliced back by MboxRelease still hold their payload
+    if (slot->slabClass != -1) {
+        slabs[slot->slabClass].numStale--;
+        returnPayload(slot);
+    }
+    return slot;
+}
+
+/*
+Returns a slot to the head of the free list so it can be reused, and gives
+its payload back to its slab class.
+
+Parameters:
+    slot - the Message instance to free
+*/
+void freeSlot(Message* slot) {
+    freePayload(slot);
+    slot->nextMessage = freeSlots;
+    freeSlots = slot;
+}
+
+/*
+Returns 1 if a mailbox can be created, and 0 if it cannot because the 
+maximum number of mailboxes has been reached. Released mailboxes that still
+have waiters flushing out of them are not available yet.
+*/
+int mailboxAvail() {
+    return numFreeIds > 0;
+}
+
+/*
+Creates a mailbox with the given number of slots and slot size.
+
+Parameters:
+    slots - the number of slots to hold messages the mailbox should have
+    slot_size - the largest message size that can be sent through this
+                mailbox
+
+Returns: the id of the allocated mailbox, or -1 in case of an error.
+*/
+int MboxCreate(int slots, int slot_size) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
     }
     int savedPsr = disableInterrupts(); 
 
@@ -377,9 +1604,28 @@ int MboxCreate(int slots, int slot_size) {
     mailbox->id = id;
     mailbox->numSlots = slots;
     mailbox->slotSize = slot_size; 
+    mailbox->slabClass = getSlabClass(slot_size);
+    mailbox->waitOrder = MBOX_FIFO;
+    mailbox->topicId = -1;
+    STAT_RESET(id);
+    mailbox->numSlotsUsed = 0;
+    for (int pri = 0; pri < MBOX_NUM_PRI; pri++) {
+        mailbox->messages[pri] = NULL;
+        mailbox->lastMessage[pri] = NULL;
+    }
+    mailbox->laneBitmap = 0;
+    mailbox->consumers = NULL;
+    mailbox->lastConsumer = NULL;
+    mailbox->producers = NULL;
+    mailbox->lastProducer = NULL;
+    mailbox->selectors = NULL;
+    mailbox->lastSelector = NULL;
+    mailbox->consumerAwake = 0;
+    mailbox->producerAwake = 0;
+    mailbox->released = 0;
+    mailbox->departing = 0;
     mailbox->filled = 1;
 
-    lastAssignedId = id;
     numMailboxes++;
 
     restoreInterrupts(savedPsr);
@@ -387,430 +1633,2601 @@ int MboxCreate(int slots, int slot_size) {
 }
 
 /*
-Destroys the mailbox with the given mbox_id. Frees all the slots of the
-mailbox and starts process to flush all producers and consumers of the 
-mailbox.
+Puts a timer into the wheel bucket that its deadline falls in, as seen from
+the current tick.
 
 Parameters:
-    mbox_id - the id of the mailbox to release
+    timer - the timer to place, with its deadline set
+*/
+void placeTimer(Timer* timer) {
+    int delta = timer->deadline - clockTicks;
+    int when = timer->deadline;
+
+    if (delta < WHEEL_SIZE) {
+        timer->level = 0;
+    }
+    else if (delta < (1 << (2 * WHEEL_BITS))) {
+        timer->level = 1;
+    }
+    else {
+        timer->level = 2;
+        if (delta >= (1 << (3 * WHEEL_BITS))) {
+            when = clockTicks + (1 << (3 * WHEEL_BITS)) - 1;
+        }
+    }
+    timer->bucket = (when >> (timer->level * WHEEL_BITS)) & WHEEL_MASK;
+
+    Timer** bucket = &timerWheel[timer->level][timer->bucket];
+    timer->prev = NULL;
+    timer->next = *bucket;
+    if (*bucket != NULL) {
+        (*bucket)->prev = timer;
+    }
+    *bucket = timer;
+}
+
+/*
+Puts the given timer on the wheel to expire the given number of clock ticks
+from now.
+
+Parameters:
+    timer - the timer to start; must not already be armed
+    ticks - the number of ticks until the timer expires, at least 1
+*/
+void startTimer(Timer* timer, int ticks) {
+    timer->deadline = clockTicks + ticks;
+    placeTimer(timer);
+    timer->armed = 1;
+    numArmedTimers++;
+}
+
+/*
+Takes the given timer off the wheel, if it is on it.
+
+Parameters:
+    timer - the timer to cancel
+*/
+void cancelTimer(Timer* timer) {
+    if (timer->armed == 0) {
+        return;
+    }
+    if (timer->prev == NULL) {
+        timerWheel[timer->level][timer->bucket] = timer->next;
+    }
+    else {
+        timer->prev->next = timer->next;
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+    timer->armed = 0;
+    numArmedTimers--;
+}
+
+/*
+Converts a timeout in microseconds to whole clock ticks, rounding up.
+
+Parameters:
+    usecs - the timeout; must be positive
+
+Returns: the number of ticks, at least 1.
+*/
+int usecsToTicks(int usecs) {
+    return (usecs + CLOCK_TICK_USECS - 1) / CLOCK_TICK_USECS;
+}
+
+/*
+Unblocks a process waiting in a mailbox's producer or consumer queue, and
+cancels its timeout if it has one. The process stays in the queue and
+takes itself out once it runs.
+
+Parameters:
+    process - the waiting process to unblock
+*/
+void wakeWaiter(struct PCB* process) {
+    cancelTimer(&process->timer);
+    TRACE(TRACE_WAKE, -1, process->pid);
+    unblockProc(process->pid);
+}
+
+/*
+Starts the timeout of a process that is about to block in one of a
+mailbox's queues.
+
+Parameters:
+    process - the process about to block
+    mbox_id - the id of the mailbox it waits on
+    isProducer - 1 if it waits in the producer queue, 0 for the consumers
+    ticks - the number of clock ticks to wait before giving up
+*/
+void startWaitTimer(struct PCB* process, int mbox_id, int isProducer, 
+        int ticks) {
+    process->waitMbox = mbox_id;
+    process->waitIsProducer = isProducer;
+    process->timedOut = 0;
+    process->timer.kind = TIMER_WAIT;
+    process->timer.owner = process;
+    startTimer(&process->timer, ticks);
+}
+
+/*
+Adds a select node to the end of its mailbox's list of MboxRecvAny waiters.
+
+Parameters:
+    node - the node to add, with waiter and mboxId already set
+*/
+void linkSelectNode(SelectNode* node) {
+    Mailbox* mailbox = &mailboxes[node->mboxId];
+    node->next = NULL;
+    node->prev = mailbox->lastSelector;
+
+    if (mailbox->selectors == NULL) {
+        mailbox->selectors = node;
+    }
+    else {
+        mailbox->lastSelector->next = node;
+    }
+    mailbox->lastSelector = node;
+    node->linked = 1;
+}
+
+/*
+Removes a select node from its mailbox's list of MboxRecvAny waiters.
+
+Parameters:
+    node - the node to remove
+*/
+void unlinkSelectNode(SelectNode* node) {
+    Mailbox* mailbox = &mailboxes[node->mboxId];
+
+    if (node->prev == NULL) {
+        mailbox->selectors = node->next;
+    }
+    else {
+        node->prev->next = node->next;
+    }
+    if (node->next == NULL) {
+        mailbox->lastSelector = node->prev;
+    }
+    else {
+        node->next->prev = node->prev;
+    }
+    node->linked = 0;
+}
+
+/*
+Wakes the first process waiting in MboxRecvAny on the given mailbox, and
+records the mailbox as the one that woke it. Nodes of processes that were
+already woken through another mailbox are dropped along the way, so each
+node is looked at only once. The woken process counts as departing the
+mailbox until it has looked at it, so a release cannot free the id first.
+
+Parameters:
+    mbox_id - the id of the mailbox that has something to receive
+
+Returns: 1 if a process was woken, and 0 if there was none to wake.
+*/
+int wakeSelector(int mbox_id) {
+    while (mailboxes[mbox_id].selectors != NULL) {
+        SelectNode* node = mailboxes[mbox_id].selectors;
+        unlinkSelectNode(node);
+
+        if (node->waiter->readyMbox == -1) {
+            node->waiter->readyMbox = mbox_id;
+            mailboxes[mbox_id].departing++;
+            TRACE(TRACE_WAKE, mbox_id, node->waiter->pid);
+            unblockProc(node->waiter->pid);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+Drops one subscriber's reference to the message with the given sequence
+number, and frees the message's slot if no subscriber is left to read it.
+Then moves the topic's oldest message past any that have been freed.
+
+Parameters:
+    topic - the topic the message was published to
+    seq - the sequence number of the message
+*/
+void unrefTopicMessage(Topic* topic, int seq) {
+    int i = seq % topic->depth;
+    topic->refs[i]--;
+    if (topic->refs[i] == 0) {
+        freeSlot(topic->ring[i]);
+        topic->ring[i] = NULL;
+        numMailboxSlots--;
+    }
+    while (topic->oldestSeq < topic->nextSeq && 
+            topic->ring[topic->oldestSeq % topic->depth] == NULL) {
+        topic->oldestSeq++;
+    }
+}
+
+/*
+Frees the oldest message of a full topic whatever subscribers have yet to
+read it. Those subscribers find out they lagged behind on their next
+receive.
+
+Parameters:
+    topic - the topic to drop the oldest message of
+*/
+void dropOldestTopicMessage(Topic* topic) {
+    int i = topic->oldestSeq % topic->depth;
+    freeSlot(topic->ring[i]);
+    topic->ring[i] = NULL;
+    topic->refs[i] = 0;
+    numMailboxSlots--;
+    topic->oldestSeq++;
+
+    while (topic->oldestSeq < topic->nextSeq && 
+            topic->ring[topic->oldestSeq % topic->depth] == NULL) {
+        topic->oldestSeq++;
+    }
+}
+
+/*
+Unblocks every subscriber waiting on a topic's mailbox, with the given
+reason. The queue is detached first, since a woken subscriber may wait
+again before the others have been unblocked. Each woken subscriber counts
+as departing the mailbox until it runs, so the topic cannot be released
+and its id reused under it.
+
+Parameters:
+    mbox_id - the id of the topic's mailbox
+    wakeStatus - 0 for a new message, -3 for the topic being released
+*/
+void wakeSubscribers(int mbox_id, int wakeStatus) {
+    PCB* waiter = mailboxes[mbox_id].consumers;
+    mailboxes[mbox_id].consumers = NULL;
+    mailboxes[mbox_id].lastConsumer = NULL;
+
+    while (waiter != NULL) {
+        PCB* next = waiter->nextInQueue;
+        waiter->wakeStatus = wakeStatus;
+        mailboxes[mbox_id].departing++;
+        TRACE(TRACE_WAKE, mbox_id, waiter->pid);
+        unblockProc(waiter->pid);
+        waiter = next;
+    }
+}
+
+/*
+Releases a topic: frees the slots of the messages it still holds, frees
+the topic, and then wakes its waiting subscribers, which return -3. The
+mailbox id is left for the last process out to free.
+
+Parameters:
+    mbox_id - the id of the topic's mailbox, already marked released
+*/
+void releaseTopic(int mbox_id) {
+    Topic* topic = &topics[mailboxes[mbox_id].topicId];
+
+    for (int seq = topic->oldestSeq; seq < topic->nextSeq; seq++) {
+        int i = seq % topic->depth;
+        if (topic->ring[i] != NULL) {
+            freeSlot(topic->ring[i]);
+            topic->ring[i] = NULL;
+            numMailboxSlots--;
+        }
+    }
+    topic->mboxId = -1;
+    wakeSubscribers(mbox_id, -3);
+}
+
+/*
+Stops every periodic timer that sends to the given mailbox, as if
+kernTimerStop had been called on each of them.
+
+Parameters:
+    mbox_id - the id of the mailbox being released
+*/
+void stopMailboxTimers(int mbox_id) {
+    for (int i = 0; i < MAXTIMERS; i++) {
+        if (periodicTimers[i].period > 0 && 
+                periodicTimers[i].mboxId == mbox_id) {
+            periodicTimers[i].period = 0;
+            cancelTimer(&periodicTimers[i]);
+        }
+    }
+}
+
+/*
+Destroys the mailbox with the given mbox_id. Frees all the slots of the
+mailbox and starts process to flush all producers and consumers of the 
+mailbox.
+
+Parameters:
+    mbox_id - the id of the mailbox to release
+
+Returns: 0 if release was successful, and -1 if the id is not currently
+in use.
+*/
+int releaseMailbox(int mbox_id) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+
+    if (mailboxes[mbox_id].filled == 0 || mailboxes[mbox_id].released == 1) {
+        return -1;
+    }
+    mailboxes[mbox_id].released = 1;
+    numMailboxes--;
+    mailboxes[mbox_id].departing = 1;
+    stopMailboxTimers(mbox_id);
+    if (mailboxes[mbox_id].producers != NULL || 
+            mailboxes[mbox_id].consumers != NULL ||
+            mailboxes[mbox_id].selectors != NULL) {
+        STAT_RELEASE();
+    }
+
+    if (mailboxes[mbox_id].topicId != -1) {
+        releaseTopic(mbox_id);
+        mailboxes[mbox_id].departing--;
+        freeIfAbandoned(mbox_id);
+        restoreInterrupts(savedPsr);
+        return 0;
+    }
+
+    // Splice each lane's message chain onto the free list at once. Payloads
+    // stay with their slots until getNextSlot hands the slots out again, and
+    // are counted as stale until then; every message of the mailbox has a
+    // payload of the mailbox's class.
+    for (int pri = 0; pri < MBOX_NUM_PRI; pri++) {
+        if (mailboxes[mbox_id].messages[pri] != NULL) {
+            mailboxes[mbox_id].lastMessage[pri]->nextMessage = freeSlots;
+            freeSlots = mailboxes[mbox_id].messages[pri];
+            mailboxes[mbox_id].messages[pri] = NULL;
+            mailboxes[mbox_id].lastMessage[pri] = NULL;
+        }
+    }
+    slabs[mailboxes[mbox_id].slabClass].numUsed -= 
+        mailboxes[mbox_id].numSlotsUsed;
+    slabs[mailboxes[mbox_id].slabClass].numStale += 
+        mailboxes[mbox_id].numSlotsUsed;
+    numMailboxSlots -= mailboxes[mbox_id].numSlotsUsed;
+    mailboxes[mbox_id].numSlotsUsed = 0;
+    mailboxes[mbox_id].laneBitmap = 0;
+
+    // A woken waiter may run before this returns, so the releasing process
+    // counts as departing too and the id stays taken until it is done
+    if (mailboxes[mbox_id].producers != NULL) {
+        wakeWaiter(mailboxes[mbox_id].producers);
+    }
+
+    if (mailboxes[mbox_id].consumers != NULL) {
+        wakeWaiter(mailboxes[mbox_id].consumers);
+    }
+    while (wakeSelector(mbox_id)) {
+    }
+
+    mailboxes[mbox_id].departing--;
+    freeIfAbandoned(mbox_id);
+
+    restoreInterrupts(savedPsr);
+    return 0;
+}
+
+/*
+Destroys the mailbox with the given mbox_id, recording the release in the
+trace ring. See releaseMailbox.
+
+Parameters:
+    mbox_id - the id of the mailbox to release
+
+Returns: 0 if release was successful, and -1 if the id is not currently
+in use.
+*/
+int MboxRelease(int mbox_id) {
+    int result = releaseMailbox(mbox_id);
+    TRACE(TRACE_RELEASE, mbox_id, result);
+    return result;
+}
+
+/*
+Adds the process with the given pid to the end of the given queue.
+
+Parameters:
+    pid - the pid of the process to add
+    head - pointer to the head of the queue to add the process to
+    tail - pointer to the tail of the queue to add the process to
+*/
+void addProcessToEndOfQueue(int pid, struct PCB** head, struct PCB** tail) {
+    struct PCB *process = &shadowProcessTable[pid % MAXPROC];
+    process->pid = pid;
+    process->nextInQueue = NULL;
+    process->prevInQueue = *tail;
+
+    if (*head == NULL) {
+        *head = process;
+    }
+    else {
+        (*tail)->nextInQueue = process;
+    }
+    *tail = process;
+} 
+
+/*
+Removes the process at the head of the given queue. Requires that the
+queue is not empty.
+
+Parameters:
+    head - pointer to the head of the queue
+    tail - pointer to the tail of the queue
+*/
+void removeProcessFromQueue(struct PCB** head, struct PCB** tail) {
+    *head = (*head)->nextInQueue;
+    if (*head == NULL) {
+        *tail = NULL;
+    }
+    else {
+        (*head)->prevInQueue = NULL;
+    }
+}
+
+/*
+Removes the given process from wherever it is in the given queue.
+
+Parameters:
+    process - the process to remove; must be in the queue
+    head - pointer to the head of the queue
+    tail - pointer to the tail of the queue
+*/
+void unlinkProcessFromQueue(struct PCB* process, struct PCB** head, 
+        struct PCB** tail) {
+    if (process->prevInQueue == NULL) {
+        *head = process->nextInQueue;
+    }
+    else {
+        process->prevInQueue->nextInQueue = process->nextInQueue;
+    }
+    if (process->nextInQueue == NULL) {
+        *tail = process->prevInQueue;
+    }
+    else {
+        process->nextInQueue->prevInQueue = process->prevInQueue;
+    }
+    process->nextInQueue = NULL;
+    process->prevInQueue = NULL;
+}
+
+/*
+Returns the priority the given process waits at in MBOX_PRIORITY mailboxes:
+the one it set with MboxSetWaitPriority, or the lowest priority if it never
+set one.
+
+Parameters:
+    process - the process
+*/
+int getWaitPriority(struct PCB* process) {
+    if (process->waitPriorityPid != process->pid) {
+        return LOWEST_WAIT_PRIORITY;
+    }
+    return process->waitPriority;
+}
+
+/*
+Adds the process with the given pid to one of a mailbox's wait queues,
+following the mailbox's queueing discipline. In an MBOX_PRIORITY mailbox
+the process goes after every waiter of the same or higher priority, so the
+queue stays FIFO within each priority. The search starts from the tail, so
+it is O(1) when every waiter has the same priority. A woken process still at
+the head of the queue is never passed, since it takes itself off the head
+once it runs.
+
+Parameters:
+    mbox_id - the id of the mailbox
+    pid - the pid of the process to add
+    isProducer - 1 for the producer queue, 0 for the consumer queue
+*/
+void addWaiterToQueue(int mbox_id, int pid, int isProducer) {
+    Mailbox* mailbox = &mailboxes[mbox_id];
+    struct PCB** head = isProducer ? &mailbox->producers : &mailbox->consumers;
+    struct PCB** tail = isProducer ? &mailbox->lastProducer : 
+        &mailbox->lastConsumer;
+    int headAwake = isProducer ? mailbox->producerAwake : 
+        mailbox->consumerAwake;
+
+    addProcessToEndOfQueue(pid, head, tail);
+    if (mailbox->waitOrder != MBOX_PRIORITY) {
+        return;
+    }
+
+    struct PCB* process = *tail;
+    int priority = getWaitPriority(process);
+    struct PCB* before = process->prevInQueue;
+    while (before != NULL && getWaitPriority(before) > priority &&
+            !(before == *head && headAwake)) {
+        before = before->prevInQueue;
+    }
+    if (before == process->prevInQueue) {
+        return;
+    }
+
+    unlinkProcessFromQueue(process, head, tail);
+    process->prevInQueue = before;
+    if (before == NULL) {
+        process->nextInQueue = *head;
+        *head = process;
+    }
+    else {
+        process->nextInQueue = before->nextInQueue;
+        before->nextInQueue = process;
+    }
+    process->nextInQueue->prevInQueue = process;
+}
+
+/*
+Called when the timeout of a process blocked in MboxSendTimeout or
+MboxRecvTimeout runs out. Takes the process out of the mailbox's queue, so
+no sender or receiver can wake it anymore, and marks it as timed out; the
+caller unblocks it. If it was the last waiter of a released mailbox, the
+mailbox's id is freed here since no one else will leave the queue to do it.
+
+Parameters:
+    process - the process whose timeout ran out
+*/
+void expireWaiter(struct PCB* process) {
+    Mailbox* mailbox = &mailboxes[process->waitMbox];
+
+    if (process->waitIsProducer) {
+        unlinkProcessFromQueue(process, &mailbox->producers, 
+            &mailbox->lastProducer);
+    }
+    else {
+        unlinkProcessFromQueue(process, &mailbox->consumers, 
+            &mailbox->lastConsumer);
+    }
+    freeIfAbandoned(process->waitMbox);
+    process->timedOut = 1;
+}
+
+/*
+Empties one bucket of the timer wheel and places each of its timers again,
+which moves them down to the level that now fits their deadline.
+
+Parameters:
+    level - the wheel level of the bucket
+    bucket - the index of the bucket in its level
+*/
+void cascadeTimers(int level, int bucket) {
+    Timer* timer = timerWheel[level][bucket];
+    timerWheel[level][bucket] = NULL;
+
+    while (timer != NULL) {
+        Timer* next = timer->next;
+        placeTimer(timer);
+        timer = next;
+    }
+}
+
+/*
+Moves the timer wheel forward one clock tick and expires every timer in the
+tick's level 0 bucket. Every expired waiter is taken out of its queue, and
+every periodic timer started again, before anything is unblocked or sent,
+since that may switch to another process before the rest are handled. A
+periodic timer that is stopped in the meantime sends nothing.
+*/
+void advanceTimers(void) {
+    clockTicks++;
+    if ((clockTicks & WHEEL_MASK) == 0) {
+        if (((clockTicks >> WHEEL_BITS) & WHEEL_MASK) == 0) {
+            cascadeTimers(2, (clockTicks >> (2 * WHEEL_BITS)) & WHEEL_MASK);
+        }
+        cascadeTimers(1, (clockTicks >> WHEEL_BITS) & WHEEL_MASK);
+    }
+
+    Timer* expired[MAXPROC + MAXTIMERS];
+    int numExpired = 0;
+    int tick = clockTicks;
+    Timer* timer = timerWheel[0][clockTicks & WHEEL_MASK];
+    timerWheel[0][clockTicks & WHEEL_MASK] = NULL;
+
+    while (timer != NULL) {
+        Timer* next = timer->next;
+        timer->armed = 0;
+        numArmedTimers--;
+        if (timer->kind == TIMER_WAIT) {
+            expireWaiter(timer->owner);
+        }
+        else if (timer->kind == TIMER_PERIODIC) {
+            startTimer(timer, timer->period);
+        }
+        expired[numExpired++] = timer;
+        timer = next;
+    }
+
+    for (int i = 0; i < numExpired; i++) {
+        if (expired[i]->kind == TIMER_PERIODIC) {
+            if (expired[i]->period > 0) {
+                MboxCondSend(expired[i]->mboxId, (void*)(&tick), sizeof(int));
+            }
+        }
+        else {
+            TRACE(TRACE_WAKE, -1, expired[i]->owner->pid);
+            unblockProc(expired[i]->owner->pid);
+        }
+    }
+}
+
+/*
+Returns the total length of the given buffers, or -1 if a buffer has a
+negative length, or is NULL but has a nonzero length.
+
+Parameters:
+    iov - the buffers
+    iovcnt - the number of buffers
+*/
+int iovecLength(const struct mbox_iovec *iov, int iovcnt) {
+    int length = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].len < 0 || (iov[i].len > 0 && iov[i].base == NULL)) {
+            return -1;
+        }
+        length += iov[i].len;
+    }
+    return length;
+}
+
+/*
+Copies len bytes from src into the given buffers, starting offset bytes
+past the beginning of the first buffer and filling each buffer in turn.
+Requires that the buffers have room for offset + len bytes.
+
+Parameters:
+    iov - the buffers to copy into
+    iovcnt - the number of buffers
+    offset - the number of bytes of the buffers to skip
+    src - the bytes to copy
+    len - the number of bytes to copy
+*/
+void scatterToIovec(const struct mbox_iovec *iov, int iovcnt, int offset,
+        const char *src, int len) {
+    for (int i = 0; i < iovcnt && len > 0; i++) {
+        if (offset >= iov[i].len) {
+            offset -= iov[i].len;
+            continue;
+        }
+        int n = iov[i].len - offset;
+        if (n > len) {
+            n = len;
+        }
+        memcpy((char*)iov[i].base + offset, src, n);
+        src += n;
+        len -= n;
+        offset = 0;
+    }
+}
+
+/*
+Writes a message to the end of the given priority's lane of the given
+mailbox. Requires that the mailbox has sufficient space for a message. The
+buffers are copied one after another straight into the slot, exactly
+msg_size bytes in all, so messages may contain any binary data.
+
+Parameters:
+    mbox_id - the id of the mailbox to write to
+    iov - the buffers holding the message to write
+    iovcnt - the number of buffers
+    msg_size - the length of the message to write
+    pri - the priority of the message, 0 being the most urgent
+*/
+void writeMessage(int mbox_id, const struct mbox_iovec *iov, int iovcnt,
+        int msg_size, int pri) {
+    Message* slot = getNextSlot();
+    allocPayload(slot, mailboxes[mbox_id].slabClass);
+       
+    int offset = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].len > 0) {
+            memcpy(slot->text + offset, iov[i].base, iov[i].len);
+            offset += iov[i].len;
+        }
+    }
+    slot->length = msg_size;
+
+    slot->nextMessage = NULL;
+    if (mailboxes[mbox_id].messages[pri] == NULL) {
+        mailboxes[mbox_id].messages[pri] = slot;
+        mailboxes[mbox_id].laneBitmap |= 1 << pri;
+    }
+    else {
+        mailboxes[mbox_id].lastMessage[pri]->nextMessage = slot;
+    }
+    mailboxes[mbox_id].lastMessage[pri] = slot;
+    mailboxes[mbox_id].numSlotsUsed += 1;
+    numMailboxSlots++;
+    STAT_DEPTH(mbox_id);
+    STAT_SLOTS();
+}
+
+/*
+Copies a message straight into the buffers of the consumer at the head of the
+mailbox's consumer queue, removes the consumer from the queue, and unblocks
+it. No slot is used. Requires that the consumer's buffers are large enough.
+Like a woken selector, the consumer counts as departing until it runs.
+
+Parameters:
+    mbox_id - the id of the mailbox being sent to
+    iov - the buffers holding the message to deliver
+    iovcnt - the number of buffers
+    msg_size - the length of the message to deliver
+*/
+void deliverToConsumer(int mbox_id, const struct mbox_iovec *iov, int iovcnt,
+        int msg_size) {
+    PCB* consumer = mailboxes[mbox_id].consumers;
+    removeProcessFromQueue(&mailboxes[mbox_id].consumers,
+        &mailboxes[mbox_id].lastConsumer);
+
+    int offset = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        scatterToIovec(consumer->msgIov, consumer->msgIovCnt, offset,
+            iov[i].base, iov[i].len);
+        offset += iov[i].len;
+    }
+    consumer->msgSize = msg_size;
+    consumer->delivered = 1;
+    mailboxes[mbox_id].departing++;
+    wakeWaiter(consumer);
+}
+
+/*
+Helper function for sending a message to a mailbox. Will block if mailbox
+does not have sufficient space depending on the value of isCond.
+
+Parameters:
+    mbox_id - the id of the mailbox to send a message to
+    iov - the buffers holding the message to send, in order
+    iovcnt - the number of buffers
+    isCond - 0 if function should block, and 1 if send is conditional
+    timeoutTicks - the most clock ticks to block for, or 0 for no limit
+    pri - the priority lane to queue the message in, 0 being the most urgent
+
+Returns: -4 if the timeout ran out, -3 if the mailbox was released, -2 if
+the mailbox has run out of slots, -1 if illegal argument values were given,
+and 0 if send was successful.
+*/
+int sendToMailbox(int mbox_id, const struct mbox_iovec *iov, int iovcnt,
+        int isCond, int timeoutTicks, int pri) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+    int msg_size = iovecLength(iov, iovcnt);
+
+    if (mailboxes[mbox_id].filled == 0 || msg_size == -1 ||
+            msg_size > mailboxes[mbox_id].slotSize ||
+            mailboxes[mbox_id].released == 1 || 
+            mailboxes[mbox_id].topicId != -1) {
+        return -1;
+    }
+
+    // A lone consumer is already waiting, so skip the slot and hand it the
+    // message; with several waiters the slot path keeps the wakeup chain
+    if (mailboxes[mbox_id].numSlots != 0 && 
+            mailboxes[mbox_id].consumers != NULL && 
+            mailboxes[mbox_id].consumerAwake == 0 &&
+            mailboxes[mbox_id].consumers == mailboxes[mbox_id].lastConsumer &&
+            msg_size <= mailboxes[mbox_id].consumers->msgMaxSize) {
+        deliverToConsumer(mbox_id, iov, iovcnt, msg_size);
+        STAT_ADD(mbox_id, sends, 1);
+        STAT_ADD(mbox_id, bytes, msg_size);
+        restoreInterrupts(savedPsr);
+        return 0;
+    }
+
+    if (numMailboxSlots >= MAXSLOTS) {
+        return -2;
+    }
+
+    if ((mailboxes[mbox_id].numSlotsUsed < mailboxes[mbox_id].numSlots &&
+            mailboxes[mbox_id].producers == NULL) || (
+            mailboxes[mbox_id].numSlots == 0 && 
+            mailboxes[mbox_id].consumers != NULL && 
+            mailboxes[mbox_id].consumerAwake == 0)) {
+
+        if (mailboxes[mbox_id].numSlots != 0) {
+            writeMessage(mbox_id, iov, iovcnt, msg_size, pri);
+        }
+
+        // Unblock process at head of consumer queue
+        if (mailboxes[mbox_id].consumers != NULL && 
+                mailboxes[mbox_id].consumerAwake == 0) {
+            mailboxes[mbox_id].consumerAwake = 1;
+            wakeWaiter(mailboxes[mbox_id].consumers);
+        }
+        else if (mailboxes[mbox_id].consumers == NULL) {
+            wakeSelector(mbox_id);
+        }
+        STAT_ADD(mbox_id, sends, 1);
+        STAT_ADD(mbox_id, bytes, msg_size);
+        restoreInterrupts(savedPsr);
+        return 0;
+    }
+    else if (!isCond) {
+        PCB* producer = &shadowProcessTable[getpid() % MAXPROC];
+        addWaiterToQueue(mbox_id, getpid(), 1);
+        if (mailboxes[mbox_id].numSlots == 0) {
+            wakeSelector(mbox_id);
+        }
+        if (timeoutTicks > 0) {
+            startWaitTimer(producer, mbox_id, 1, timeoutTicks);
+        }
+        STAT_ADD(mbox_id, producerBlocks, 1);
+        TRACE(TRACE_BLOCK, mbox_id, 13);
+        int blockStart = currentTime();
+        blockMe(13);
+
+        // The timer already took this process out of the producer queue
+        if (producer->timedOut == 1) {
+            producer->timedOut = 0;
+            restoreInterrupts(savedPsr);
+            return -4;
+        }
+
+        if (mailboxes[mbox_id].released == 1) {
+            removeProcessFromQueue(&mailboxes[mbox_id].producers,
+                &mailboxes[mbox_id].lastProducer);
+            if (mailboxes[mbox_id].producers != NULL) {
+                wakeWaiter(mailboxes[mbox_id].producers);
+            }
+            else {
+                freeIfAbandoned(mbox_id);
+            }
+            return -3;
+        }
+        STAT_BLOCKED(mbox_id, blockStart);
+        
+        // Write message to slot once unblocked and unblock next producer if
+        // applicable
+        if (mailboxes[mbox_id].numSlots != 0) {
+            writeMessage(mbox_id, iov, iovcnt, msg_size, pri);
+        }
+
+        removeProcessFromQueue(&mailboxes[mbox_id].producers,
+            &mailboxes[mbox_id].lastProducer);
+
+        if (mailboxes[mbox_id].consumers != NULL && 
+                mailboxes[mbox_id].consumerAwake == 0) {
+            mailboxes[mbox_id].consumerAwake = 1;
+            wakeWaiter(mailboxes[mbox_id].consumers);
+        }        
+        else if (mailboxes[mbox_id].consumers == NULL && 
+                mailboxes[mbox_id].numSlots != 0) {
+            wakeSelector(mbox_id);
+        }
+        if (mailboxes[mbox_id].numSlotsUsed < mailboxes[mbox_id].numSlots &&
+                mailboxes[mbox_id].producers != NULL) {
+            wakeWaiter(mailboxes[mbox_id].producers);
+        }
+        else {
+            mailboxes[mbox_id].producerAwake = 0;
+        }
+
+        STAT_ADD(mbox_id, sends, 1);
+        STAT_ADD(mbox_id, bytes, msg_size);
+        restoreInterrupts(savedPsr);
+        return 0;
+    } 
+    else {
+        STAT_ADD(mbox_id, condFails, 1);
+        restoreInterrupts(savedPsr);
+        return -2;
+    }
+}
+
+/*
+Sends a message through sendToMailbox and records the result in the trace
+ring. Takes the same parameters and returns the same values.
+*/
+int Send(int mbox_id, const struct mbox_iovec *iov, int iovcnt, int isCond,
+        int timeoutTicks, int pri) {
+    int result = sendToMailbox(mbox_id, iov, iovcnt, isCond, timeoutTicks, pri);
+    TRACE(TRACE_SEND, mbox_id, result);
+    return result;
+}
+
+/*
+Sends a message to the given mailbox, and blocks the process if the mailbox 
+is full. The message will be sent eventually once the mailbox has open slots,
+depending on where the process is in the producer queue.
+
+Parameters:
+    mbox_id - the id of the mailbox to send a message to
+    msg_ptr - pointer to the message to send
+    msg_size - the length of the message to send
+
+Returns: -3 if the mailbox was released, -2 if the system has run out of
+slots, -1 if illegal argument values were given, and 0 if send was
+successful.
+*/
+int MboxSend(int mbox_id, void *msg_ptr, int msg_size) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    struct mbox_iovec iov = { msg_ptr, msg_size };
+    int savedPsr = disableInterrupts(); 
+    int retVal = Send(mbox_id, &iov, 1, 0, 0, MBOX_PRI_NORMAL);
+    restoreInterrupts(savedPsr);
+    return retVal;
+}
+
+/*
+Sends a message to the given mailbox, but does not block in the case the
+mailbox is full.
+
+Parameters:
+    mbox_id - the id of the mailbox to send a message to
+    msg_ptr - pointer to the message to send
+    msg_size - the length of the message to send
+
+Returns: -3 if the mailbox was released, -2 if the system has run out of
+slots, -1 if illegal argument values were given, and 0 if send was
+successful.
+*/
+int MboxCondSend(int mbox_id, void *msg_ptr, int msg_size) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    struct mbox_iovec iov = { msg_ptr, msg_size };
+    int savedPsr = disableInterrupts(); 
+    int retVal = Send(mbox_id, &iov, 1, 1, 0, MBOX_PRI_NORMAL);
+    restoreInterrupts(savedPsr);
+    return retVal;
+}
+
+/*
+Reads the first message of the most urgent nonempty lane of the given
+mailbox, filling the buffers in order straight from the slot. The lowest
+set bit of the lane bitmap names that lane. Requires that the mailbox has
+a message.
+
+Parameters:
+    mbox_id - the id of the mailbox to read from
+    iov - the buffers to hold the message read
+    iovcnt - the number of buffers
+    msg_max_size - the total size of the buffers; can receive up to this size
+
+Returns: -1 if the message does not fit in the buffers, and the length of
+the message otherwise.
+*/
+int readMessage(int mbox_id, const struct mbox_iovec *iov, int iovcnt,
+        int msg_max_size) {
+    int pri = __builtin_ctz(mailboxes[mbox_id].laneBitmap);
+    Message* slot = mailboxes[mbox_id].messages[pri];
+    int length = slot->length;
+
+    if (length > msg_max_size) {
+        return -1;
+    }  
+    scatterToIovec(iov, iovcnt, 0, slot->text, length);
+    mailboxes[mbox_id].messages[pri] = slot->nextMessage;
+    if (mailboxes[mbox_id].messages[pri] == NULL) {
+        mailboxes[mbox_id].lastMessage[pri] = NULL;
+        mailboxes[mbox_id].laneBitmap &= ~(1 << pri);
+    }
+    freeSlot(slot);
+    mailboxes[mbox_id].numSlotsUsed -= 1;
+    numMailboxSlots--;
+    return length;
+}
+
+/*
+Helper function to receive message from a mailbox. Blocks upon encountering an 
+empty mailbox depending on value of isCond. If consumer is blocked, then the
+process is added to the consumer queue of the mailbox, and a message is received
+when available.
+
+Parameters:
+    mbox_id - the id of the mailbox to receive from
+    iov - the buffers to hold the received message, in order
+    iovcnt - the number of buffers
+    isCond - 0 if function should block, and 1 if receive is conditional
+    timeoutTicks - the most clock ticks to block for, or 0 for no limit
+
+Returns: -4 if the timeout ran out, -3 if mailbox was released, -1 if illegal
+values were given as arguments, and the size of the message received
+otherwise.
+*/
+int receiveFromMailbox(int mbox_id, const struct mbox_iovec *iov, int iovcnt,
+        int isCond, int timeoutTicks) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+    int size = 0;
+    int msg_max_size = iovecLength(iov, iovcnt);
+
+    if (mailboxes[mbox_id].filled == 0 || msg_max_size == -1 ||
+            mailboxes[mbox_id].released == 1 || 
+            mailboxes[mbox_id].topicId != -1) {
+	return -1;
+    }
+    if ((mailboxes[mbox_id].numSlotsUsed > 0 && 
+            mailboxes[mbox_id].consumerQueued == 0) || (
+            mailboxes[mbox_id].numSlots == 0 &&
+            mailboxes[mbox_id].producers != NULL && 
+            mailboxes[mbox_id].producerAwake == 0)) {
+
+        if (mailboxes[mbox_id].numSlots != 0) {
+            size = readMessage(mbox_id, iov, iovcnt, msg_max_size);
+            if (size == -1) {
+                return -1;
+            }
+        }
+        
+        // Unblock process at the head of producer queue after receiving msg
+        if (mailboxes[mbox_id].producers != NULL && 
+                mailboxes[mbox_id].producerAwake == 0) {
+            mailboxes[mbox_id].producerAwake = 1;
+            wakeWaiter(mailboxes[mbox_id].producers);
+        }
+    }
+    else if (!isCond) {
+        PCB* consumer = &shadowProcessTable[getpid() % MAXPROC];
+        consumer->msgIov = iov;
+        consumer->msgIovCnt = iovcnt;
+        consumer->msgMaxSize = msg_max_size;
+        consumer->delivered = 0;
+
+        addWaiterToQueue(mbox_id, getpid(), 0);
+        if (timeoutTicks > 0) {
+            startWaitTimer(consumer, mbox_id, 0, timeoutTicks);
+        }
+        STAT_ADD(mbox_id, consumerBlocks, 1);
+        TRACE(TRACE_BLOCK, mbox_id, 14);
+        int blockStart = currentTime();
+	blockMe(14);
+
+        // The timer already took this process out of the consumer queue
+        if (consumer->timedOut == 1) {
+            consumer->timedOut = 0;
+            restoreInterrupts(savedPsr);
+            return -4;
+        }
+
+        // A sender already copied the message into the buffers
+        if (consumer->delivered == 1) {
+            consumer->delivered = 0;
+            mailboxes[mbox_id].departing--;
+            if (mailboxes[mbox_id].released == 0) {
+                STAT_BLOCKED(mbox_id, blockStart);
+                STAT_ADD(mbox_id, recvs, 1);
+            }
+            freeIfAbandoned(mbox_id);
+            restoreInterrupts(savedPsr);
+            return consumer->msgSize;
+        }
+
+        if (mailboxes[mbox_id].released == 1) {
+            removeProcessFromQueue(&mailboxes[mbox_id].consumers,
+                &mailboxes[mbox_id].lastConsumer);
+            if (mailboxes[mbox_id].consumers != NULL) {
+                wakeWaiter(mailboxes[mbox_id].consumers);
+            }
+            else {
+                freeIfAbandoned(mbox_id);
+            }
+            return -3;
+        }
+        STAT_BLOCKED(mbox_id, blockStart);
+
+        // Receive message and unblock next consumer if applicable	
+        if (mailboxes[mbox_id].numSlots != 0) {
+            size = readMessage(mbox_id, iov, iovcnt, msg_max_size);
+            if (size == -1) {
+                return -1;
+            }
+        }
+
+        removeProcessFromQueue(&mailboxes[mbox_id].consumers,
+            &mailboxes[mbox_id].lastConsumer);
+	
+        if (mailboxes[mbox_id].producers != NULL && 
+                mailboxes[mbox_id].producerAwake == 0) {
+            mailboxes[mbox_id].producerAwake = 1;
+            wakeWaiter(mailboxes[mbox_id].producers);
+        }
+        if (mailboxes[mbox_id].consumers != NULL && 
+                mailboxes[mbox_id].laneBitmap != 0) {
+	    wakeWaiter(mailboxes[mbox_id].consumers);
+	}
+        else {
+            mailboxes[mbox_id].consumerAwake = 0;
+        }	
+    }
+    else {
+        STAT_ADD(mbox_id, condFails, 1);
+        restoreInterrupts(savedPsr);
+        return -2;
+    }
+
+    STAT_ADD(mbox_id, recvs, 1);
+    restoreInterrupts(savedPsr);
+    return size;
+}
+
+/*
+Receives a message through receiveFromMailbox and records the result in the
+trace ring. Takes the same parameters and returns the same values.
+*/
+int Recv(int mbox_id, const struct mbox_iovec *iov, int iovcnt, int isCond,
+        int timeoutTicks) {
+    int result = receiveFromMailbox(mbox_id, iov, iovcnt, isCond, timeoutTicks);
+    TRACE(TRACE_RECV, mbox_id, result);
+    return result;
+}
+
+/*
+Function to receive message from a mailbox. Blocks upon encountering an 
+empty mailbox. If consumer is blocked, then the process is added to the 
+consumer queue of the mailbox, and a message is received when available.
+
+Parameters:
+    mbox_id - the id of the mailbox to receive from
+    msg_ptr - pointer to buffer to hold received message
+    msg_max_size - the size of the buffer; can receive up to this size
+
+Returns: -3 if mailbox was released, -1 if illegal values were given as arguments,
+and the size of the message received otherwise.
+*/
+int MboxRecv(int mbox_id, void *msg_ptr, int msg_max_size) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    struct mbox_iovec iov = { msg_ptr, msg_max_size };
+    int savedPsr = disableInterrupts(); 
+    int retVal = Recv(mbox_id, &iov, 1, 0, 0);
+    restoreInterrupts(savedPsr);
+    return retVal;
+}
+
+/*
+Function to receive message from a mailbox that does not block when a message is
+not available.
+
+Parameters:
+    mbox_id - the id of the mailbox to receive from
+    msg_ptr - pointer to buffer to hold received message
+    msg_max_size - the size of the buffer; can receive up to this size
+
+Returns: -3 if mailbox was released, -1 if illegal values were given as arguments,
+and the size of the message received otherwise.
+*/
+int MboxCondRecv(int mbox_id, void *msg_ptr, int msg_max_size) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    struct mbox_iovec iov = { msg_ptr, msg_max_size };
+    int savedPsr = disableInterrupts(); 
+    int retVal = Recv(mbox_id, &iov, 1, 1, 0);
+    restoreInterrupts(savedPsr);
+    return retVal;
+}
+
+/*
+Sends up to n messages to the given mailbox in a single critical section.
+Blocks like MboxSend until the first message can be sent, then sends as
+many of the rest as fit without blocking again. A waiting consumer is woken
+at most once; it wakes the next consumer while messages remain.
+
+Parameters:
+    mbox_id - the id of the mailbox to send the messages to
+    msgs - pointers to the messages to send, in order
+    sizes - the length of each message
+    n - the number of messages to send
+
+Returns: -3 if the mailbox was released, -2 if the system has run out of
+slots, -1 if illegal argument values were given, and the number of
+messages sent otherwise.
+*/
+int MboxSendMany(int mbox_id, void *msgs[], int sizes[], int n) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+    Mailbox* mailbox = &mailboxes[mbox_id];
+
+    if (n < 0 || mailbox->filled == 0 || mailbox->released == 1 ||
+            mailbox->topicId != -1) {
+        restoreInterrupts(savedPsr);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        if (sizes[i] < 0 || sizes[i] > mailbox->slotSize || 
+                (sizes[i] > 0 && msgs[i] == NULL)) {
+            restoreInterrupts(savedPsr);
+            return -1;
+        }
+    }
+    if (n == 0) {
+        restoreInterrupts(savedPsr);
+        return 0;
+    }
+
+    // Only block if not even the first message can be queued right now
+    int sent = 0;
+    if (mailbox->numSlotsUsed >= mailbox->numSlots || 
+            mailbox->producers != NULL || numMailboxSlots >= MAXSLOTS) {
+        struct mbox_iovec iov = { msgs[0], sizes[0] };
+        int ret = Send(mbox_id, &iov, 1, 0, 0, MBOX_PRI_NORMAL);
+        if (ret != 0) {
+            restoreInterrupts(savedPsr);
+            return ret;
+        }
+        sent = 1;
+    }
+
+    while (sent < n && mailbox->numSlotsUsed < mailbox->numSlots &&
+            mailbox->producers == NULL && numMailboxSlots < MAXSLOTS) {
+        struct mbox_iovec iov = { msgs[sent], sizes[sent] };
+        writeMessage(mbox_id, &iov, 1, sizes[sent], MBOX_PRI_NORMAL);
+        STAT_ADD(mbox_id, sends, 1);
+        STAT_ADD(mbox_id, bytes, sizes[sent]);
+        sent++;
+    }
+
+    if (mailbox->consumers != NULL && mailbox->consumerAwake == 0) {
+        mailbox->consumerAwake = 1;
+        wakeWaiter(mailbox->consumers);
+    }
+    else if (mailbox->consumers == NULL) {
+        wakeSelector(mbox_id);
+    }
+
+    restoreInterrupts(savedPsr);
+    return sent;
+}
+
+/*
+Receives up to n messages from the given mailbox in a single critical
+section. Blocks like MboxRecv until the first message arrives, then takes
+as many of the queued messages as are available without blocking again. A
+waiting producer is woken at most once; it wakes the next producer while
+slots remain.
+
+Parameters:
+    mbox_id - the id of the mailbox to receive from
+    bufs - the buffers to hold the received messages, in order
+    maxsizes - the size of each buffer; on return, holds the length of each
+               message received
+    n - the largest number of messages to receive
+    got - out pointer to deliver the number of messages received
+
+Returns: -3 if the mailbox was released, -1 if illegal values were given as
+arguments or the first message does not fit its buffer, and 0 otherwise.
+*/
+int MboxRecvMany(int mbox_id, void *bufs[], int maxsizes[], int n, int *got) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+    Mailbox* mailbox = &mailboxes[mbox_id];
+
+    if (n < 0 || got == NULL || mailbox->filled == 0 || 
+            mailbox->released == 1 || mailbox->topicId != -1) {
+        restoreInterrupts(savedPsr);
+        return -1;
+    }
+    *got = 0;
+    if (n == 0) {
+        restoreInterrupts(savedPsr);
+        return 0;
+    }
+
+    // Only block if there is nothing queued for this process to take
+    if (mailbox->numSlotsUsed == 0 || mailbox->consumers != NULL) {
+        struct mbox_iovec iov = { bufs[0], maxsizes[0] };
+        int size = Recv(mbox_id, &iov, 1, 0, 0);
+        if (size < 0) {
+            restoreInterrupts(savedPsr);
+            return size;
+        }
+        maxsizes[0] = size;
+        *got = 1;
+    }
+
+    while (*got < n && mailbox->laneBitmap != 0 && 
+            mailbox->consumers == NULL) {
+        struct mbox_iovec iov = { bufs[*got], maxsizes[*got] };
+        int size = readMessage(mbox_id, &iov, 1, maxsizes[*got]);
+        if (size == -1) {
+            break;
+        }
+        maxsizes[*got] = size;
+        STAT_ADD(mbox_id, recvs, 1);
+        (*got)++;
+    }
+
+    if (mailbox->producers != NULL && mailbox->producerAwake == 0) {
+        mailbox->producerAwake = 1;
+        wakeWaiter(mailbox->producers);
+    }
+
+    restoreInterrupts(savedPsr);
+    return *got > 0 ? 0 : -1;
+}
+
+/*
+Sends a message gathered from several buffers to the given mailbox, copying
+each buffer straight into the slot. Blocks like MboxSend if the mailbox is
+full.
+
+Parameters:
+    mbox_id - the id of the mailbox to send a message to
+    iov - the buffers holding the message, in order
+    iovcnt - the number of buffers
+
+Returns: -3 if the mailbox was released, -2 if the system has run out of
+slots, -1 if illegal argument values were given, and 0 if send was
+successful.
+*/
+int MboxSendV(int mbox_id, const struct mbox_iovec *iov, int iovcnt) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    if (iovcnt < 0 || (iovcnt > 0 && iov == NULL)) {
+        return -1;
+    }
+    int savedPsr = disableInterrupts(); 
+    int retVal = Send(mbox_id, iov, iovcnt, 0, 0, MBOX_PRI_NORMAL);
+    restoreInterrupts(savedPsr);
+    return retVal;
+}
+
+/*
+Receives a message from the given mailbox, scattering it straight from the
+slot across several buffers, each filled before the next. Blocks like
+MboxRecv if the mailbox is empty.
+
+Parameters:
+    mbox_id - the id of the mailbox to receive from
+    iov - the buffers to hold the message, in order
+    iovcnt - the number of buffers
+
+Returns: -3 if mailbox was released, -1 if illegal values were given as
+arguments or the message does not fit, and the size of the message received
+otherwise.
+*/
+int MboxRecvV(int mbox_id, const struct mbox_iovec *iov, int iovcnt) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    if (iovcnt < 0 || (iovcnt > 0 && iov == NULL)) {
+        return -1;
+    }
+    int savedPsr = disableInterrupts(); 
+    int retVal = Recv(mbox_id, iov, iovcnt, 0, 0);
+    restoreInterrupts(savedPsr);
+    return retVal;
+}
+
+/*
+Receives a message from whichever of the given mailboxes has one first.
+Mailboxes that already have a message are checked in order; if none does,
+the process waits on all of them at once, and the first mailbox to get a
+message (or be released) wakes it.
+
+Parameters:
+    ids - the ids of the mailboxes to receive from
+    n - the number of mailboxes, up to MAXRECVANY
+    which - out pointer to deliver the id of the mailbox received from
+    msg_ptr - pointer to buffer to hold received message
+    msg_max_size - the size of the buffer; can receive up to this size
+
+Returns: -3 if the mailbox in *which was released, -1 if illegal values
+were given as arguments, and the size of the message received otherwise.
+*/
+int MboxRecvAny(int ids[], int n, int *which, void *msg_ptr, 
+        int msg_max_size) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+    struct mbox_iovec iov = { msg_ptr, msg_max_size };
+    PCB* waiter = &shadowProcessTable[getpid() % MAXPROC];
+    SelectNode* nodes = selectNodes[getpid() % MAXPROC];
+
+    if (n < 1 || n > MAXRECVANY || which == NULL) {
+        restoreInterrupts(savedPsr);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        if (ids[i] < 0 || ids[i] >= MAXMBOX || 
+                mailboxes[ids[i]].filled == 0 || 
+                mailboxes[ids[i]].released == 1 ||
+                mailboxes[ids[i]].topicId != -1) {
+            restoreInterrupts(savedPsr);
+            return -1;
+        }
+    }
+
+    while (1) {
+        for (int i = 0; i < n; i++) {
+            int ret = Recv(ids[i], &iov, 1, 1, 0);
+            if (ret != -2) {
+                *which = ids[i];
+                restoreInterrupts(savedPsr);
+                return ret;
+            }
+        }
+
+        waiter->pid = getpid();
+        waiter->readyMbox = -1;
+        for (int i = 0; i < n; i++) {
+            nodes[i].waiter = waiter;
+            nodes[i].mboxId = ids[i];
+            linkSelectNode(&nodes[i]);
+        }
+        TRACE(TRACE_BLOCK, -1, 15);
+        blockMe(15);
+
+        for (int i = 0; i < n; i++) {
+            if (nodes[i].linked == 1) {
+                unlinkSelectNode(&nodes[i]);
+            }
+        }
+        // The mailbox that woke us keeps its id until we have looked at it
+        mailboxes[waiter->readyMbox].departing--;
+        if (mailboxes[waiter->readyMbox].released == 1) {
+            *which = waiter->readyMbox;
+            freeIfAbandoned(waiter->readyMbox);
+            restoreInterrupts(savedPsr);
+            return -3;
+        }
+
+        // Try the mailbox that woke us first, in case another process is
+        // about to take its message
+        int ret = Recv(waiter->readyMbox, &iov, 1, 1, 0);
+        if (ret != -2) {
+            *which = waiter->readyMbox;
+            restoreInterrupts(savedPsr);
+            return ret;
+        }
+    }
+}
+
+/*
+Sends a message to the given mailbox like MboxSend, but gives up if the
+mailbox stays full for longer than the given timeout. The timeout is
+counted in clock ticks, so it is rounded up to a whole number of ticks.
+
+Parameters:
+    mbox_id - the id of the mailbox to send a message to
+    msg_ptr - pointer to the message to send
+    msg_size - the length of the message to send
+    timeout_usecs - the most microseconds to wait; must be positive
+
+Returns: -4 if the timeout ran out, -3 if the mailbox was released, -2 if
+the system has run out of slots, -1 if illegal argument values were given,
+and 0 if send was successful.
+*/
+int MboxSendTimeout(int mbox_id, void *msg_ptr, int msg_size, 
+        int timeout_usecs) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    if (timeout_usecs <= 0) {
+        return -1;
+    }
+    struct mbox_iovec iov = { msg_ptr, msg_size };
+    int savedPsr = disableInterrupts(); 
+    int retVal = Send(mbox_id, &iov, 1, 0, usecsToTicks(timeout_usecs),
+        MBOX_PRI_NORMAL);
+    restoreInterrupts(savedPsr);
+    return retVal;
+}
+
+/*
+Receives a message from the given mailbox like MboxRecv, but gives up if
+no message arrives within the given timeout. The timeout is counted in
+clock ticks, so it is rounded up to a whole number of ticks.
+
+Parameters:
+    mbox_id - the id of the mailbox to receive from
+    msg_ptr - pointer to buffer to hold received message
+    msg_max_size - the size of the buffer; can receive up to this size
+    timeout_usecs - the most microseconds to wait; must be positive
+
+Returns: -4 if the timeout ran out, -3 if mailbox was released, -1 if
+illegal values were given as arguments, and the size of the message
+received otherwise.
+*/
+int MboxRecvTimeout(int mbox_id, void *msg_ptr, int msg_max_size, 
+        int timeout_usecs) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    if (timeout_usecs <= 0) {
+        return -1;
+    }
+    struct mbox_iovec iov = { msg_ptr, msg_max_size };
+    int savedPsr = disableInterrupts(); 
+    int retVal = Recv(mbox_id, &iov, 1, 0, usecsToTicks(timeout_usecs));
+    restoreInterrupts(savedPsr);
+    return retVal;
+}
+
+/*
+Blocks the current process for at least the given time. The process is
+woken by the clock interrupt on which the time runs out, so the sleep is
+rounded up to a whole number of clock ticks. One more tick is added since
+the next tick may come at any time after the call.
+
+Parameters:
+    usecs - the number of microseconds to sleep for
+
+Returns: -1 if usecs is negative, and 0 otherwise.
+*/
+int kernSleep(int usecs) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    if (usecs < 0) {
+        return -1;
+    }
+    if (usecs == 0) {
+        return 0;
+    }
+    int savedPsr = disableInterrupts(); 
+    PCB* sleeper = &shadowProcessTable[getpid() % MAXPROC];
+
+    sleeper->pid = getpid();
+    sleeper->timer.kind = TIMER_SLEEP;
+    sleeper->timer.owner = sleeper;
+    startTimer(&sleeper->timer, usecsToTicks(usecs) + 1);
+    TRACE(TRACE_BLOCK, -1, 16);
+    blockMe(16);
+
+    restoreInterrupts(savedPsr);
+    return 0;
+}
+
+/*
+Starts a periodic timer that sends the current clock tick count, as an int,
+to the given mailbox every period. The send never blocks; if the mailbox is
+full, that tick is dropped. The period is rounded up to whole clock ticks.
+While the timer runs it counts as pending I/O for deadlock detection.
+
+Parameters:
+    period_usecs - the number of microseconds between sends
+    mbox_id - the id of the mailbox to send to; its slots must hold an int
+
+Returns: the id of the timer, or -1 if the arguments are invalid or
+MAXTIMERS timers are already running.
+*/
+int kernTimerStart(int period_usecs, int mbox_id) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+
+    if (period_usecs <= 0 || mbox_id < 0 || mbox_id >= MAXMBOX ||
+            mailboxes[mbox_id].filled == 0 || 
+            mailboxes[mbox_id].released == 1 ||
+            mailboxes[mbox_id].topicId != -1 ||
+            mailboxes[mbox_id].slotSize < (int)sizeof(int)) {
+        restoreInterrupts(savedPsr);
+        return -1;
+    }
+    for (int i = 0; i < MAXTIMERS; i++) {
+        Timer* timer = &periodicTimers[i];
+        if (timer->period == 0) {
+            timer->period = usecsToTicks(period_usecs);
+            timer->mboxId = mbox_id;
+            startTimer(timer, timer->period);
+            restoreInterrupts(savedPsr);
+            return i;
+        }
+    }
+
+    restoreInterrupts(savedPsr);
+    return -1;
+}
+
+/*
+Stops a periodic timer started by kernTimerStart.
+
+Parameters:
+    timer_id - the id of the timer to stop
+
+Returns: -1 if no timer with that id is running, and 0 otherwise.
+*/
+int kernTimerStop(int timer_id) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+
+    if (timer_id < 0 || timer_id >= MAXTIMERS || 
+            periodicTimers[timer_id].period == 0) {
+        restoreInterrupts(savedPsr);
+        return -1;
+    }
+    periodicTimers[timer_id].period = 0;
+    cancelTimer(&periodicTimers[timer_id]);
+
+    restoreInterrupts(savedPsr);
+    return 0;
+}
+
+/*
+Creates a mailbox like MboxCreate, with the given order for the processes
+waiting to send to or receive from it. MBOX_FIFO mailboxes are the same as
+the ones MboxCreate makes. In MBOX_PRIORITY mailboxes, a waiter with a
+higher priority (set with MboxSetWaitPriority) goes ahead of lower priority
+waiters, and waiters of the same priority are served in order of arrival.
+
+Parameters:
+    slots - the number of slots to hold messages the mailbox should have
+    slot_size - the largest message size that can be sent through this
+                mailbox
+    wait_order - MBOX_FIFO or MBOX_PRIORITY
+
+Returns: the id of the allocated mailbox, or -1 in case of an error.
+*/
+int MboxCreateOrdered(int slots, int slot_size, int wait_order) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    if (wait_order != MBOX_FIFO && wait_order != MBOX_PRIORITY) {
+        return -1;
+    }
+    int savedPsr = disableInterrupts(); 
+    int id = MboxCreate(slots, slot_size);
+    if (id >= 0) {
+        mailboxes[id].waitOrder = wait_order;
+    }
+    restoreInterrupts(savedPsr);
+    return id;
+}
+
+/*
+Sets the priority the calling process waits at in MBOX_PRIORITY mailboxes.
+Phase 1 does not let phase 2 look up a process's priority, so a process
+that wants to be ordered by priority declares it here, normally with the
+priority it was forked at. A process that never calls this waits at the
+lowest priority. The setting ends when the process does.
+
+Parameters:
+    priority - the priority, from 1 (highest) to 5 (lowest)
+
+Returns: -1 if the priority is out of range, and 0 otherwise.
+*/
+int MboxSetWaitPriority(int priority) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    if (priority < 1 || priority > LOWEST_WAIT_PRIORITY) {
+        return -1;
+    }
+    int savedPsr = disableInterrupts(); 
+    PCB* process = &shadowProcessTable[getpid() % MAXPROC];
+    process->pid = getpid();
+    process->waitPriority = priority;
+    process->waitPriorityPid = getpid();
+    restoreInterrupts(savedPsr);
+    return 0;
+}
+
+/*
+Sends a message to the given mailbox like MboxSend, but queues it in the
+given priority's lane. Receivers always take the first message of the most
+urgent nonempty lane, so urgent messages pass the ones MboxSend queued
+(which go in the least urgent lane, MBOX_PRI_NORMAL). Messages in one lane
+stay in the order they were sent.
+
+Parameters:
+    mbox_id - the id of the mailbox to send a message to
+    msg_ptr - pointer to the message to send
+    msg_size - the length of the message to send
+    pri - the priority of the message, from 0 (most urgent) to
+          MBOX_NUM_PRI - 1
+
+Returns: -3 if the mailbox was released, -2 if the system has run out of
+slots, -1 if illegal argument values were given, and 0 if send was
+successful.
+*/
+int MboxSendPri(int mbox_id, void *msg_ptr, int msg_size, int pri) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    if (pri < 0 || pri >= MBOX_NUM_PRI) {
+        return -1;
+    }
+    struct mbox_iovec iov = { msg_ptr, msg_size };
+    int savedPsr = disableInterrupts(); 
+    int retVal = Send(mbox_id, &iov, 1, 0, 0, pri);
+    restoreInterrupts(savedPsr);
+    return retVal;
+}
+
+/*
+Creates a topic: a mailbox whose messages are published once and read by
+every subscriber, each through its own cursor. A published message takes
+one slot however many subscribers there are, and its slot is freed once the
+last of them has read it. The topic keeps at most depth messages. When it
+is full, lag_policy says what a publish does: TOPIC_DROP_OLDEST drops the
+oldest message, and subscribers that had not read it get -5 from their next
+receive; TOPIC_REJECT_NEW fails the publish instead.
+
+Parameters:
+    depth - the most messages the topic keeps, up to MAXTOPICDEPTH
+    slot_size - the largest message size that can be published
+    lag_policy - TOPIC_DROP_OLDEST or TOPIC_REJECT_NEW
+
+Returns: the id of the topic's mailbox, or -1 in case of an error.
+*/
+int MboxCreateTopic(int depth, int slot_size, int lag_policy) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+
+    if (depth < 1 || depth > MAXTOPICDEPTH || (lag_policy != 
+            TOPIC_DROP_OLDEST && lag_policy != TOPIC_REJECT_NEW)) {
+        restoreInterrupts(savedPsr);
+        return -1;
+    }
+    for (int t = 0; t < MAXTOPICS; t++) {
+        if (topics[t].mboxId == -1) {
+            int id = MboxCreate(0, slot_size);
+            if (id == -1) {
+                restoreInterrupts(savedPsr);
+                return -1;
+            }
+            Topic* topic = &topics[t];
+            topic->mboxId = id;
+            topic->depth = depth;
+            topic->lagPolicy = lag_policy;
+            topic->oldestSeq = 0;
+            topic->nextSeq = 0;
+            topic->numSubscribers = 0;
+            for (int i = 0; i < MAXPROC; i++) {
+                topic->subscribed[i] = 0;
+            }
+            mailboxes[id].topicId = t;
+
+            restoreInterrupts(savedPsr);
+            return id;
+        }
+    }
+
+    restoreInterrupts(savedPsr);
+    return -1;
+}
+
+/*
+Returns the topic of the given mailbox, or NULL if the id is not that of
+a topic in use.
+
+Parameters:
+    mbox_id - the id of the mailbox
+*/
+Topic* getTopic(int mbox_id) {
+    if (mbox_id < 0 || mbox_id >= MAXMBOX || mailboxes[mbox_id].filled == 0 ||
+            mailboxes[mbox_id].released == 1 || 
+            mailboxes[mbox_id].topicId == -1) {
+        return NULL;
+    }
+    return &topics[mailboxes[mbox_id].topicId];
+}
+
+/*
+Adds a subscriber to a topic. The subscriber receives every message
+published from now on.
+
+Parameters:
+    topic_id - the id of the topic's mailbox
+
+Returns: the subscriber id to receive with, or -1 if the id is not that of
+a topic or the topic already has MAXPROC subscribers.
+*/
+int MboxSubscribe(int topic_id) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+    Topic* topic = getTopic(topic_id);
+
+    if (topic != NULL) {
+        for (int sub = 0; sub < MAXPROC; sub++) {
+            if (topic->subscribed[sub] == 0) {
+                topic->subscribed[sub] = 1;
+                topic->cursor[sub] = topic->nextSeq;
+                topic->numSubscribers++;
+                restoreInterrupts(savedPsr);
+                return sub;
+            }
+        }
+    }
+
+    restoreInterrupts(savedPsr);
+    return -1;
+}
+
+/*
+Removes a subscriber from a topic, dropping its references to the messages
+it has not read yet.
+
+Parameters:
+    topic_id - the id of the topic's mailbox
+    sub_id - the subscriber id from MboxSubscribe
+
+Returns: -1 if the ids are not those of a topic and one of its
+subscribers, and 0 otherwise.
+*/
+int MboxUnsubscribe(int topic_id, int sub_id) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+    Topic* topic = getTopic(topic_id);
+
+    if (topic == NULL || sub_id < 0 || sub_id >= MAXPROC || 
+            topic->subscribed[sub_id] == 0) {
+        restoreInterrupts(savedPsr);
+        return -1;
+    }
+    int seq = topic->cursor[sub_id];
+    if (seq < topic->oldestSeq) {
+        seq = topic->oldestSeq;
+    }
+    for (; seq < topic->nextSeq; seq++) {
+        if (topic->ring[seq % topic->depth] != NULL) {
+            unrefTopicMessage(topic, seq);
+        }
+    }
+    topic->subscribed[sub_id] = 0;
+    topic->numSubscribers--;
+
+    restoreInterrupts(savedPsr);
+    return 0;
+}
+
+/*
+Publishes a message to every current subscriber of a topic, copying it
+once into a single slot. Never blocks. A message published while there are
+no subscribers is dropped, since no one could ever read it.
+
+Parameters:
+    topic_id - the id of the topic's mailbox
+    msg_ptr - pointer to the message to publish
+    msg_size - the length of the message
+
+Returns: -2 if the topic is full and rejects new messages, or the system
+has run out of slots, -1 if illegal argument values were given, and 0 if
+the message was published.
+*/
+int MboxPublish(int topic_id, void *msg_ptr, int msg_size) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+    Topic* topic = getTopic(topic_id);
+
+    if (topic == NULL || msg_size < 0 || 
+            msg_size > mailboxes[topic_id].slotSize ||
+            (msg_size > 0 && msg_ptr == NULL)) {
+        restoreInterrupts(savedPsr);
+        return -1;
+    }
+    if (topic->numSubscribers == 0) {
+        restoreInterrupts(savedPsr);
+        return 0;
+    }
+    if (topic->nextSeq - topic->oldestSeq == topic->depth) {
+        if (topic->lagPolicy == TOPIC_REJECT_NEW) {
+            STAT_ADD(topic_id, condFails, 1);
+            restoreInterrupts(savedPsr);
+            return -2;
+        }
+        dropOldestTopicMessage(topic);
+    }
+    if (numMailboxSlots >= MAXSLOTS) {
+        restoreInterrupts(savedPsr);
+        return -2;
+    }
+
+    Message* slot = getNextSlot();
+    allocPayload(slot, mailboxes[topic_id].slabClass);
+    if (msg_size > 0) {
+        memcpy(slot->text, msg_ptr, msg_size);
+    }
+    slot->length = msg_size;
+    numMailboxSlots++;
+    STAT_SLOTS();
+    STAT_ADD(topic_id, sends, 1);
+    STAT_ADD(topic_id, bytes, msg_size);
+
+    int i = topic->nextSeq % topic->depth;
+    topic->ring[i] = slot;
+    topic->refs[i] = topic->numSubscribers;
+    topic->nextSeq++;
+
+    wakeSubscribers(topic_id, 0);
+    restoreInterrupts(savedPsr);
+    return 0;
+}
+
+/*
+Receives the next message of a topic for one subscriber, copying it from
+the shared slot. Blocks until a message is published if the subscriber has
+read them all. If messages the subscriber had not read were dropped, the
+subscriber is moved up to the oldest message still kept and -5 is returned;
+the next call receives that message.
+
+Parameters:
+    topic_id - the id of the topic's mailbox
+    sub_id - the subscriber id from MboxSubscribe
+    msg_ptr - pointer to buffer to hold received message
+    msg_max_size - the size of the buffer; can receive up to this size
+
+Returns: -5 if the subscriber lagged and lost messages, -3 if the topic was
+released, -1 if illegal values were given as arguments or the message does
+not fit in the buffer, and the size of the message received otherwise.
+*/
+int MboxRecvTopic(int topic_id, int sub_id, void *msg_ptr, int msg_max_size) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int savedPsr = disableInterrupts(); 
+    Topic* topic = getTopic(topic_id);
+
+    if (topic == NULL || sub_id < 0 || sub_id >= MAXPROC || 
+            topic->subscribed[sub_id] == 0 || msg_max_size < 0 ||
+            (msg_max_size > 0 && msg_ptr == NULL)) {
+        restoreInterrupts(savedPsr);
+        return -1;
+    }
+
+    while (topic->cursor[sub_id] == topic->nextSeq) {
+        PCB* waiter = &shadowProcessTable[getpid() % MAXPROC];
+        addProcessToEndOfQueue(getpid(), &mailboxes[topic_id].consumers,
+            &mailboxes[topic_id].lastConsumer);
+        STAT_ADD(topic_id, consumerBlocks, 1);
+        TRACE(TRACE_BLOCK, topic_id, 14);
+        blockMe(14);
+
+        // A publish may have woken us just before the topic was released
+        mailboxes[topic_id].departing--;
+        if (waiter->wakeStatus == -3 || mailboxes[topic_id].released == 1) {
+            freeIfAbandoned(topic_id);
+            restoreInterrupts(savedPsr);
+            return -3;
+        }
+        if (topic->subscribed[sub_id] == 0) {
+            restoreInterrupts(savedPsr);
+            return -1;
+        }
+    }
+
+    if (topic->cursor[sub_id] < topic->oldestSeq) {
+        topic->cursor[sub_id] = topic->oldestSeq;
+        restoreInterrupts(savedPsr);
+        return -5;
+    }
+
+    int seq = topic->cursor[sub_id];
+    Message* slot = topic->ring[seq % topic->depth];
+    if (slot->length > msg_max_size) {
+        restoreInterrupts(savedPsr);
+        return -1;
+    }
+    int length = slot->length;
+    if (length > 0) {
+        memcpy(msg_ptr, slot->text, length);
+    }
+    topic->cursor[sub_id]++;
+    unrefTopicMessage(topic, seq);
+    STAT_ADD(topic_id, recvs, 1);
+
+    restoreInterrupts(savedPsr);
+    return length;
+}
+
+/*
+Records one event in the trace ring, overwriting the oldest event if the
+ring is full. Only called through TRACE, once tracing is known to be on.
+
+Parameters:
+    op - one of the TRACE_ ops
+    mbox_id - the mailbox involved, or -1 if none
+    result - the op's result, status or pid, as described by the op
+*/
+void traceRecord(int op, int mbox_id, int result) {
+    unsigned int savedPsr = disableInterrupts();
+    TraceEvent* event = &traceRing[traceNext];
+
+    event->time = currentTime();
+    event->pid = getpid();
+    event->mboxId = mbox_id;
+    event->op = op;
+    event->result = result;
+    traceNext = (traceNext + 1) % TRACE_RING_SIZE;
+    if (traceCount < TRACE_RING_SIZE) {
+        traceCount++;
+    }
+    restoreInterrupts(savedPsr);
+}
+
+/*
+Turns recording of mailbox events into the trace ring on or off. Events
+already in the ring are kept either way.
+
+Parameters:
+    enable - 1 to start recording, 0 to stop
+
+Returns: 1 if tracing was on before the call, and 0 otherwise.
+*/
+int traceEnable(int enable) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    int wasEnabled = traceEnabled;
+    traceEnabled = (enable != 0);
+    return wasEnabled;
+}
+
+/*
+Writes the events in the trace ring, oldest first, to a host file in the
+Chrome trace-event JSON format. Each process is a thread of one trace
+process. A block begins a slice on the blocking process's thread and the
+wakeup that unblocks it ends the slice; every other event is an instant.
+Nothing is written if the ring is empty.
+
+Parameters:
+    path - the host file to write, replaced if it exists
+
+Returns: -1 if the file could not be opened, and the number of events
+written otherwise.
+*/
+int traceExport(char *path) {
+    static const char* opNames[] = {
+        "send", "recv", "block", "wake", "release", "interrupt"
+    };
+    if (traceCount == 0) {
+        return 0;
+    }
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    int first = (traceNext - traceCount + TRACE_RING_SIZE) % TRACE_RING_SIZE;
+    for (int i = 0; i < traceCount; i++) {
+        TraceEvent* event = &traceRing[(first + i) % TRACE_RING_SIZE];
+        char phase = 'i';
+        int tid = event->pid;
+        if (event->op == TRACE_BLOCK) {
+            phase = 'B';
+        }
+        else if (event->op == TRACE_WAKE) {
+            phase = 'E';
+            tid = event->result;
+        }
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%d,"
+            "\"pid\":0,\"tid\":%d,%s\"args\":{\"pid\":%d,\"mbox\":%d,"
+            "\"result\":%d}}%s\n", opNames[event->op], phase, event->time,
+            tid, phase == 'i' ? "\"s\":\"t\"," : "", event->pid,
+            event->mboxId, event->result, i == traceCount - 1 ? "" : ",");
+    }
+    fprintf(file, "]}\n");
+    fclose(file);
+    return traceCount;
+}
+
+/*
+Reports how long processes have blocked sending to or receiving from a
+mailbox, or from every mailbox together. Durations are in microseconds,
+and the percentiles are accurate to within a quarter of their value.
+
+Parameters:
+    mbox_id - the id of the mailbox, or -1 for all mailboxes
+    p50 - out pointer for the median block duration
+    p99 - out pointer for the 99th percentile block duration
+    max - out pointer for the longest block duration
+
+Returns: -1 if the id is not a mailbox in use or statistics are compiled
+out, and the number of blocks measured otherwise. The out pointers are
+set to 0 if there were none.
+*/
+int MboxBlockLatency(int mbox_id, int *p50, int *p99, int *max) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+#if MBOX_STATS
+    LatencyHist* hist = &blockLatency;
+    if (mbox_id != -1) {
+        if (mbox_id < 0 || mbox_id >= MAXMBOX || 
+                mailboxes[mbox_id].filled == 0 ||
+                mailboxes[mbox_id].released == 1) {
+            return -1;
+        }
+        hist = &mailboxes[mbox_id].stats.blockLatency;
+    }
+
+    int savedPsr = disableInterrupts();
+    *p50 = 0;
+    *p99 = 0;
+    *max = hist->max;
+    if (hist->samples > 0) {
+        *p50 = latencyPercentile(hist, 50);
+        *p99 = latencyPercentile(hist, 99);
+    }
+    int samples = hist->samples;
+    restoreInterrupts(savedPsr);
+    return samples;
+#else
+    return -1;
+#endif
+}
+
+/*
+Forgets the block durations measured so far for a mailbox, or for the
+global histogram. Resetting one does not change the other.
+
+Parameters:
+    mbox_id - the id of the mailbox, or -1 for the global histogram
+
+Returns: -1 if the id is not a mailbox in use or statistics are compiled
+out, and 0 otherwise.
+*/
+int MboxResetLatency(int mbox_id) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+#if MBOX_STATS
+    LatencyHist* hist = &blockLatency;
+    if (mbox_id != -1) {
+        if (mbox_id < 0 || mbox_id >= MAXMBOX || 
+                mailboxes[mbox_id].filled == 0 ||
+                mailboxes[mbox_id].released == 1) {
+            return -1;
+        }
+        hist = &mailboxes[mbox_id].stats.blockLatency;
+    }
+    memset(hist, 0, sizeof(LatencyHist));
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/*
+Sets how many interrupt statuses a terminal or disk unit keeps for
+waitDevice before it starts dropping them. Statuses already queued are
+kept in order.
+
+Parameters:
+    type - the type of device (disk or terminal)
+    unit - the unit number of the device
+    depth - the new depth, from 1 to MAXDEVICERING
 
-Returns: 0 if release was successful, and -1 if the id is not currently
-in use.
+Returns: -1 if the unit does not exist, the depth is out of range, or more
+statuses than depth are queued, and 0 otherwise.
 */
-int MboxRelease(int mbox_id) {
+int waitDeviceDepth(int type, int unit, int depth) {
     if (USLOSS_PsrGet() % 2 == 0) {
         USLOSS_Console("Process is not in kernel mode.\n");
         USLOSS_Halt(1);
     }
-    int savedPsr = disableInterrupts(); 
-
-    if (mailboxes[mbox_id].filled == 0) {
+    DeviceRing* ring = getDeviceRing(type, unit);
+    if (ring == NULL || depth < 1 || depth > MAXDEVICERING) {
         return -1;
     }
-    mailboxes[mbox_id].released = 1;
-    numMailboxes--;
-
-    Message* messages = mailboxes[mbox_id].messages;
-    while (messages != NULL) {
-        messages->filled = 0;
-        numMailboxSlots--;
-        messages = messages->nextMessage;
-    }
 
-    if (mailboxes[mbox_id].producers != NULL) {
-        unblockProc(mailboxes[mbox_id].producers->pid);
+    int savedPsr = disableInterrupts();
+    if (ring->count > depth) {
+        restoreInterrupts(savedPsr);
+        return -1;
     }
-
-    if (mailboxes[mbox_id].consumers != NULL) {
-        unblockProc(mailboxes[mbox_id].consumers->pid);
+    int statuses[MAXDEVICERING];
+    for (int i = 0; i < ring->count; i++) {
+        statuses[i] = ring->statuses[(ring->head + i) % ring->depth];
     }
-
+    memcpy(ring->statuses, statuses, ring->count * sizeof(int));
+    ring->head = 0;
+    ring->depth = depth;
     restoreInterrupts(savedPsr);
     return 0;
 }
 
 /*
-Adds a message to the end of the given list of messages.
+Returns how many interrupt statuses of a terminal or disk unit have been
+dropped because its ring was full, or -1 if the unit does not exist.
 
 Parameters:
-    slot - the Message instance to add
-    messages - the list of messages to add to
+    type - the type of device (disk or terminal)
+    unit - the unit number of the device
 */
-void addMessageToMailbox(struct Message* slot, struct Message* messages) {
-    struct Message* temp = messages;
-    while (temp->nextMessage != NULL) {
-        temp = temp->nextMessage;
+int waitDeviceOverflows(int type, int unit) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
+    }
+    DeviceRing* ring = getDeviceRing(type, unit);
+    if (ring == NULL) {
+        return -1;
     }
-    temp->nextMessage = slot;
+    return ring->overflows;
 }
 
 /*
-Adds the process with the given pid to the end of the given queue.
+Puts a terminal in line mode, if it is not already, and returns the id of
+its line mailbox. From then on received characters are edited into lines
+and each finished line, newline included, is sent to the mailbox, so a
+reader can MboxRecv a whole line at a time. Received characters no longer
+reach waitDevice. Receive interrupts must still be turned on for the
+terminal.
 
 Parameters:
-    pid - the pid of the process to add
-    queue - the queue to add the process to
+    unit - the unit number of the terminal
+
+Returns: -2 if no mailbox is left for the lines, -1 if the unit does not
+exist, and the id of the line mailbox otherwise.
 */
-void addProcessToEndOfQueue(int pid, struct PCB* queue) {
-    struct PCB *process = &shadowProcessTable[pid % MAXPROC];
-   
-    struct PCB* temp = queue;
-    while (temp->nextInQueue != NULL) {
-        temp = temp->nextInQueue;
+int termLineMailbox(int unit) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
     }
-    temp->nextInQueue = process;
-} 
+    if (unit < 0 || unit > 3) {
+        return -1;
+    }
+
+    int savedPsr = disableInterrupts();
+    if (termLines[unit].mboxId == -1) {
+        int mbox_id = MboxCreate(TERM_LINE_SLOTS, MAXLINE);
+        if (mbox_id == -1) {
+            restoreInterrupts(savedPsr);
+            return -2;
+        }
+        termLines[unit].length = 0;
+        termLines[unit].mboxId = mbox_id;
+    }
+    restoreInterrupts(savedPsr);
+    return termLines[unit].mboxId;
+}
 
 /*
-Writes a message to the given mailbox. Requires that the mailbox has
-sufficient space for a message.
+Returns how many finished lines a terminal in line mode has dropped
+because its line mailbox was full, or -1 if the unit does not exist.
 
 Parameters:
-    mbox_id - the id of the mailbox to write to
-    msg_ptr - pointer to the message to write
+    unit - the unit number of the terminal
 */
-void writeMessage(int mbox_id, void *msg_ptr) {
-    Message* slot = &mailSlots[getNextSlot()];
-       
-    if (msg_ptr != NULL) {
-        strcpy(slot->text, msg_ptr);
-    }
-    else {
-        slot->text[0] = '\0';
-    }
-    slot->filled = 1;
-
-    if (mailboxes[mbox_id].messages == NULL) {
-        mailboxes[mbox_id].messages = slot;
+int termLinesLost(int unit) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
     }
-    else {
-        addMessageToMailbox(slot, mailboxes[mbox_id].messages);
+    if (unit < 0 || unit > 3) {
+        return -1;
     }
-    mailboxes[mbox_id].numSlotsUsed += 1;
-    lastAssignedSlot++;
-    numMailboxSlots++;
+    return termLines[unit].lostLines;
 }
 
 /*
-Helper function for sending a message to a mailbox. Will block if mailbox
-does not have sufficient space depending on the value of isCond.
+Queues a line to be sent to a terminal and returns without waiting for it
+to be sent, unless the terminal already has TERM_OUT_SLOTS lines queued.
+The terminal handler sends the line one character per transmit interrupt,
+and lines from different writers are never mixed. Receive interrupts are
+kept on while the line is sent.
 
 Parameters:
-    mbox_id - the id of the mailbox to send a message to
-    msg_ptr - pointer to the message to send
-    msg_size - the length of the message to send
-    isCond - 0 if function should block, and 1 if send is conditional
+    unit - the unit number of the terminal
+    buf - the characters to send
+    len - the number of characters, at most MAXLINE
 
-Returns: -3 if the mailbox was released, -2 if the mailbox has run out of
-slots, -1 if illegal argument values were given, and 0 if send was
-successful.
+Returns: -2 if no mailbox is left for the terminal's output, -1 if
+illegal argument values were given, and len otherwise.
 */
-int Send(int mbox_id, void *msg_ptr, int msg_size, int isCond) {
+int termWrite(int unit, char *buf, int len) {
     if (USLOSS_PsrGet() % 2 == 0) {
         USLOSS_Console("Process is not in kernel mode.\n");
         USLOSS_Halt(1);
     }
-    int savedPsr = disableInterrupts(); 
-
-    if (numMailboxSlots >= MAXSLOTS) {
-        return -2;
-    }
-    if (mailboxes[mbox_id].filled == 0 || (msg_size > 0 && msg_ptr == NULL) ||
-            msg_size > mailboxes[mbox_id].slotSize ||
-            mailboxes[mbox_id].released == 1) {
+    if (unit < 0 || unit > 3 || len < 0 || len > MAXLINE || 
+            (buf == NULL && len > 0)) {
         return -1;
     }
-
-    if ((mailboxes[mbox_id].numSlotsUsed < mailboxes[mbox_id].numSlots &&
-            mailboxes[mbox_id].producers == NULL) || (
-            mailboxes[mbox_id].numSlots == 0 && 
-            mailboxes[mbox_id].consumers != NULL && 
-            consumerAwake == 0)) {
-
-        if (mailboxes[mbox_id].numSlots != 0) {
-            writeMessage(mbox_id, msg_ptr);
-        }
-
-        // Unblock process at head of consumer queue
-        if (mailboxes[mbox_id].consumers != NULL && consumerAwake == 0) {
-            consumerAwake = 1;
-            unblockProc(mailboxes[mbox_id].consumers->pid);
-        }
-        restoreInterrupts(savedPsr);
+    if (len == 0) {
         return 0;
     }
-    else if (!isCond) {
-        shadowProcessTable[getpid() % MAXPROC].pid = getpid();
-        if (mailboxes[mbox_id].producers == NULL) {
-            mailboxes[mbox_id].producers = &shadowProcessTable[getpid() % 
-                MAXPROC];
-        }
-	    else {
-            addProcessToEndOfQueue(getpid(), mailboxes[mbox_id].producers);
-        }
-        blockMe(13);
 
-        if (mailboxes[mbox_id].released == 1) {
-            mailboxes[mbox_id].producers = mailboxes[mbox_id].producers->nextInQueue;
-            if (mailboxes[mbox_id].producers != NULL) {
-                unblockProc(mailboxes[mbox_id].producers->pid);
-            }
-            else {
-                mailboxes[mbox_id].filled = 0;
-            }
-            return -3;
+    TermOutput* out = &termOutputs[unit];
+    int savedPsr = disableInterrupts();
+    if (out->mboxId == -1) {
+        out->mboxId = MboxCreate(TERM_OUT_SLOTS, MAXLINE);
+        if (out->mboxId == -1) {
+            restoreInterrupts(savedPsr);
+            return -2;
         }
-        
-        // Write message to slot once unblocked and unblock next producer if
-        // applicable
-        if (mailboxes[mbox_id].numSlots != 0) {
-            writeMessage(mbox_id, msg_ptr);
-        }
-
-        mailboxes[mbox_id].producers = mailboxes[mbox_id].producers->nextInQueue;
+    }
 
-        if (mailboxes[mbox_id].consumers != NULL && consumerAwake == 0) {
-            consumerAwake = 1;
-            unblockProc(mailboxes[mbox_id].consumers->pid);
-        }        
-        if (mailboxes[mbox_id].numSlotsUsed < mailboxes[mbox_id].numSlots &&
-                mailboxes[mbox_id].producers != NULL) {
-            unblockProc(mailboxes[mbox_id].producers->pid);
-        }
-        else {
-            producerAwake = 0;
-        }
+    out->queued++;
+    MboxSend(out->mboxId, buf, len);
 
-        restoreInterrupts(savedPsr);
-        return 0;
-    } 
-    else {
-        restoreInterrupts(savedPsr);
-        return -2;
+    // The terminal may have gone idle while this writer waited for a slot
+    if (!out->busy) {
+        transmitNext(out, unit);
     }
+    restoreInterrupts(savedPsr);
+    return len;
 }
 
 /*
-Sends a message to the given mailbox, and blocks the process if the mailbox 
-is full. The message will be sent eventually once the mailbox has open slots,
-depending on where the process is in the producer queue.
+Blocks until every line written to a terminal before the call has been
+sent. Lines written by others while waiting are not waited for.
 
 Parameters:
-    mbox_id - the id of the mailbox to send a message to
-    msg_ptr - pointer to the message to send
-    msg_size - the length of the message to send
+    unit - the unit number of the terminal
 
-Returns: -3 if the mailbox was released, -2 if the system has run out of
-slots, -1 if illegal argument values were given, and 0 if send was
-successful.
+Returns: -1 if the unit does not exist, and 0 otherwise.
 */
-int MboxSend(int mbox_id, void *msg_ptr, int msg_size) {
+int termFlush(int unit) {
     if (USLOSS_PsrGet() % 2 == 0) {
         USLOSS_Console("Process is not in kernel mode.\n");
         USLOSS_Halt(1);
     }
-    int savedPsr = disableInterrupts(); 
-    int retVal = Send(mbox_id, msg_ptr, msg_size, 0);
+    if (unit < 0 || unit > 3) {
+        return -1;
+    }
+
+    TermOutput* out = &termOutputs[unit];
+    int savedPsr = disableInterrupts();
+    if (out->sent < out->queued) {
+        PCB* flusher = &shadowProcessTable[getpid() % MAXPROC];
+        flusher->flushSeq = out->queued;
+        addProcessToEndOfQueue(getpid(), &out->flushers, &out->lastFlusher);
+        TRACE(TRACE_BLOCK, -1, 19);
+        blockMe(19);
+    }
     restoreInterrupts(savedPsr);
-    return retVal;
+    return 0;
 }
 
 /*
-Sends a message to the given mailbox, but does not block in the case the
-mailbox is full.
+Turns a terminal's receive interrupts on or off. Buffered output writes
+the terminal's control register for every character, so programs that
+use termWrite set receive interrupts here rather than with
+USLOSS_DeviceOutput, which the next character sent would undo. While a
+character is being sent, the setting takes effect with the next one.
 
 Parameters:
-    mbox_id - the id of the mailbox to send a message to
-    msg_ptr - pointer to the message to send
-    msg_size - the length of the message to send
+    unit - the unit number of the terminal
+    on - 1 to turn receive interrupts on, and 0 to turn them off
 
-Returns: -3 if the mailbox was released, -2 if the system has run out of
-slots, -1 if illegal argument values were given, and 0 if send was
-successful.
+Returns: -1 if the unit does not exist, and 0 otherwise.
 */
-int MboxCondSend(int mbox_id, void *msg_ptr, int msg_size) {
+int termRecvInt(int unit, int on) {
     if (USLOSS_PsrGet() % 2 == 0) {
         USLOSS_Console("Process is not in kernel mode.\n");
         USLOSS_Halt(1);
     }
-    int savedPsr = disableInterrupts(); 
-    int retVal = Send(mbox_id, msg_ptr, msg_size, 1);
+    if (unit < 0 || unit > 3) {
+        return -1;
+    }
+
+    TermOutput* out = &termOutputs[unit];
+    int savedPsr = disableInterrupts();
+    out->recvInt = on ? USLOSS_TERM_CTRL_RECV_INT(0) : 0;
+    if (!out->busy) {
+        USLOSS_DeviceOutput(USLOSS_TERM_DEV, unit, (void*)out->recvInt);
+    }
     restoreInterrupts(savedPsr);
-    return retVal;
+    return 0;
 }
 
 /*
-Reads the first message from the given mailbox.
+Has the current process wait for a terminal to receive a character. The
+first call splits the terminal's statuses into receive and transmit
+channels, so that transmit interrupts no longer wake receivers; from then
+on waitDevice on the terminal behaves like waitDeviceRx. Characters that
+arrived earlier are taken oldest first.
 
 Parameters:
-    mbox_id - the id of the mailbox to read from
-    msg_ptr - the out pointer to hold the message read
-    msg_max_size - the size of the buffer; can receive up to this size
-
-Returns: -1 if illegal argument values were given, and 0 otherwise.
+    unit - the unit number of the terminal
+    status - out pointer to deliver the terminal status, which has the
+             received character in it
 */
-int readMessage(int mbox_id, void *msg_ptr, int msg_max_size) {
-    Message* slot = mailboxes[mbox_id].messages;
-
-    if (strlen(slot->text) + 1 > msg_max_size && 
-            !(mailboxes[mbox_id].slotSize == 0 && msg_max_size == 0)) {
-        return -1;
-    }  
-    if (msg_max_size != 0) {
-        memcpy(msg_ptr, slot->text, msg_max_size);
+void waitDeviceRx(int unit, int *status) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
     }
-    slot->filled = 0;
-    
-    mailboxes[mbox_id].messages = slot->nextMessage;
-    mailboxes[mbox_id].numSlotsUsed -= 1;
-    numMailboxSlots--;
-    return 0;
+    if (unit < 0 || unit > 3) {
+        USLOSS_Console("ERROR\n");
+        USLOSS_Halt(1);
+    }
+
+    int savedPsr = disableInterrupts();
+    splitTerminal(unit);
+    takeDeviceStatus(&deviceRings[unit], 1 + unit, status);
+    restoreInterrupts(savedPsr);
 }
 
 /*
-Helper function to receive message from a mailbox. Blocks upon encountering an 
-empty mailbox depending on value of isCond. If consumer is blocked, then the
-process is added to the consumer queue of the mailbox, and a message is received
-when available.
+Has the current process wait for a terminal's transmitter to finish
+sending a character. The first call splits the terminal's statuses into
+receive and transmit channels, so that received characters no longer
+wake transmitters. A transmit interrupt that came while no process was
+waiting is taken right away.
 
 Parameters:
-    mbox_id - the id of the mailbox to receive from
-    msg_ptr - pointer to buffer to hold received message
-    msg_max_size - the size of the buffer; can receive up to this size
-
-Returns: -3 if mailbox was released, -1 if illegal values were given as arguments,
-and the size of the message received otherwise.
+    unit - the unit number of the terminal
+    status - out pointer to deliver the terminal status
 */
-int Recv(int mbox_id, void *msg_ptr, int msg_max_size, int isCond) {
+void waitDeviceTx(int unit, int *status) {
     if (USLOSS_PsrGet() % 2 == 0) {
         USLOSS_Console("Process is not in kernel mode.\n");
         USLOSS_Halt(1);
     }
-    int savedPsr = disableInterrupts(); 
-
-    if (mailboxes[mbox_id].filled == 0 ||
-            mailboxes[mbox_id].released == 1) {
-	return -1;
+    if (unit < 0 || unit > 3) {
+        USLOSS_Console("ERROR\n");
+        USLOSS_Halt(1);
     }
-    if ((mailboxes[mbox_id].numSlotsUsed > 0 && 
-            mailboxes[mbox_id].consumerQueued == 0) || (
-            mailboxes[mbox_id].numSlots == 0 &&
-            mailboxes[mbox_id].producers != NULL && producerAwake == 0)) {
 
-        if (mailboxes[mbox_id].numSlots != 0) {
-            int ret = readMessage(mbox_id, msg_ptr, msg_max_size);
-            if (ret == -1) {
-                return -1;
-            }
-        }
-        
-        // Unblock process at the head of producer queue after receiving msg
-        if (mailboxes[mbox_id].producers != NULL && producerAwake == 0) {
-            producerAwake = 1;
-            unblockProc(mailboxes[mbox_id].producers->pid);
-        }
+    TermChannels* chan = &termChannels[unit];
+    int savedPsr = disableInterrupts();
+    splitTerminal(unit);
+    if (chan->txPending) {
+        chan->txPending = 0;
+        *status = chan->txStatus;
     }
-    else if (!isCond) {
-        shadowProcessTable[getpid() % MAXPROC].pid = getpid();
-	if (mailboxes[mbox_id].consumers == NULL) {
-            mailboxes[mbox_id].consumers = &shadowProcessTable[getpid() % 
-                MAXPROC];
-        }
-	else {
-            addProcessToEndOfQueue(getpid(), mailboxes[mbox_id].consumers);
-        }
-	blockMe(14);
+    else {
+        PCB* waiter = &shadowProcessTable[getpid() % MAXPROC];
+        addProcessToEndOfQueue(getpid(), &chan->txWaiters, 
+            &chan->lastTxWaiter);
+        TRACE(TRACE_BLOCK, 1 + unit, 18);
+        blockMe(18);
+        *status = waiter->deviceStatus;
+    }
+    restoreInterrupts(savedPsr);
+}
 
-        if (mailboxes[mbox_id].released == 1) {
-            mailboxes[mbox_id].consumers = mailboxes[mbox_id].consumers->nextInQueue;
-            if (mailboxes[mbox_id].consumers != NULL) {
-                unblockProc(mailboxes[mbox_id].consumers->pid);
-            }
-            else {
-                mailboxes[mbox_id].filled = 0;
-            }
-            return -3;
-        }
+/*
+Reads or writes sectors of one disk track through the unit's request
+queue, and blocks until they are done. The unit serves queued requests in
+the order set by diskSetPolicy, C-LOOK unless changed, one sector per
+interrupt. While requests are queued, the unit's interrupts are not seen
+by waitDevice.
 
-        // Receive message and unblock next consumer if applicable	
-        if (mailboxes[mbox_id].numSlots != 0) {
-            int ret = readMessage(mbox_id, msg_ptr, msg_max_size);
-            if (ret == -1) {
-                return -1;
-            }
-        }
+Parameters:
+    unit - the unit number of the disk
+    op - USLOSS_DISK_READ or USLOSS_DISK_WRITE
+    track - the track to read or write
+    first_sector - the first sector, on that track
+    sectors - the number of sectors, which must all be on that track
+    buf - the buffer of sectors * USLOSS_DISK_SECTOR_SIZE bytes
 
-        mailboxes[mbox_id].consumers = mailboxes[mbox_id].consumers->nextInQueue;
-	
-        if (mailboxes[mbox_id].producers != NULL && producerAwake == 0) {
-            producerAwake = 1;
-            unblockProc(mailboxes[mbox_id].producers->pid);
-        }
-        if (mailboxes[mbox_id].consumers != NULL && 
-                mailboxes[mbox_id].messages != NULL) {
-	    unblockProc(mailboxes[mbox_id].consumers->pid);
-	}
-        else {
-            consumerAwake = 0;
-        }	
+Returns: -1 if illegal argument values were given, 0 if the sectors were
+read or written, and the disk's error status otherwise.
+*/
+int diskRequest(int unit, int op, int track, int first_sector, int sectors,
+        void *buf) {
+    if (USLOSS_PsrGet() % 2 == 0) {
+        USLOSS_Console("Process is not in kernel mode.\n");
+        USLOSS_Halt(1);
     }
-    else {
-        restoreInterrupts(savedPsr);
-        return -2;
+    if (unit < 0 || unit > 1 || 
+            (op != USLOSS_DISK_READ && op != USLOSS_DISK_WRITE) || 
+            track < 0 || first_sector < 0 || sectors < 1 || 
+            first_sector + sectors > USLOSS_DISK_TRACK_SIZE || buf == NULL) {
+        return -1;
     }
 
-    restoreInterrupts(savedPsr);
-    if (mailboxes[mbox_id].numSlots != 0 && msg_max_size != 0 
-            && strlen(msg_ptr) != 0) {        
-        return strlen(msg_ptr) + 1;
-    } else {
-        return 0;
+    DiskQueue* queue = &diskQueues[unit];
+    DiskRequest* req = &diskRequests[getpid() % MAXPROC];
+    int savedPsr = disableInterrupts();
+    req->op = op;
+    req->track = track;
+    req->sector = first_sector;
+    req->sectors = sectors;
+    req->done = 0;
+    req->buf = buf;
+    req->finished = 0;
+    req->owner = &shadowProcessTable[getpid() % MAXPROC];
+    req->owner->pid = getpid();
+    req->owner->isBlocked = 0;
+    req->next = NULL;
+
+    DiskRequest** link = &queue->pending;
+    while (*link != NULL) {
+        link = &(*link)->next;
+    }
+    *link = req;
+    if (queue->current == NULL) {
+        startDiskRequest(queue, unit);
+    }
+
+    // The disk may have rejected the request before it could block
+    if (!req->finished) {
+        req->owner->isBlocked = 1;
+        TRACE(TRACE_BLOCK, 5 + unit, 18);
+        blockMe(18);
     }
+    restoreInterrupts(savedPsr);
+    return req->owner->deviceStatus;
 }
 
 /*
-Function to receive message from a mailbox. Blocks upon encountering an 
-empty mailbox. If consumer is blocked, then the process is added to the 
-consumer queue of the mailbox, and a message is received when available.
+Sets the order a disk unit serves its queued requests in.
 
 Parameters:
-    mbox_id - the id of the mailbox to receive from
-    msg_ptr - pointer to buffer to hold received message
-    msg_max_size - the size of the buffer; can receive up to this size
+    unit - the unit number of the disk
+    policy - DISK_FIFO or DISK_CLOOK
 
-Returns: -3 if mailbox was released, -1 if illegal values were given as arguments,
-and the size of the message received otherwise.
+Returns: -1 if illegal argument values were given, and 0 otherwise.
 */
-int MboxRecv(int mbox_id, void *msg_ptr, int msg_max_size) {
+int diskSetPolicy(int unit, int policy) {
     if (USLOSS_PsrGet() % 2 == 0) {
         USLOSS_Console("Process is not in kernel mode.\n");
         USLOSS_Halt(1);
     }
-    int savedPsr = disableInterrupts(); 
-    int retVal = Recv(mbox_id, msg_ptr, msg_max_size, 0);
-    restoreInterrupts(savedPsr);
-    return retVal;
+    if (unit < 0 || unit > 1 || 
+            (policy != DISK_FIFO && policy != DISK_CLOOK)) {
+        return -1;
+    }
+    diskQueues[unit].policy = policy;
+    return 0;
 }
 
 /*
-Function to receive message from a mailbox that does not block when a message is
-not available.
+Reports the work a disk unit's request queue has done so far.
 
 Parameters:
-    mbox_id - the id of the mailbox to receive from
-    msg_ptr - pointer to buffer to hold received message
-    msg_max_size - the size of the buffer; can receive up to this size
+    unit - the unit number of the disk
+    seeks - out pointer for the number of seeks to a different track
+    tracks - out pointer for the total tracks crossed by those seeks
+    merged - out pointer for the number of requests that continued the
+             previous transfer without a seek
 
-Returns: -3 if mailbox was released, -1 if illegal values were given as arguments,
-and the size of the message received otherwise.
+Returns: -1 if the unit does not exist, and 0 otherwise.
 */
-int MboxCondRecv(int mbox_id, void *msg_ptr, int msg_max_size) {
+int diskStats(int unit, int *seeks, int *tracks, int *merged) {
     if (USLOSS_PsrGet() % 2 == 0) {
         USLOSS_Console("Process is not in kernel mode.\n");
         USLOSS_Halt(1);
     }
-    int savedPsr = disableInterrupts(); 
-    int retVal = Recv(mbox_id, msg_ptr, msg_max_size, 1);
-    restoreInterrupts(savedPsr);
-    return retVal;
+    if (unit < 0 || unit > 1) {
+        return -1;
+    }
+    *seeks = diskQueues[unit].seeks;
+    *tracks = diskQueues[unit].tracks;
+    *merged = diskQueues[unit].merged;
+    return 0;
 }
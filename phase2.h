@@ -13,6 +13,29 @@
 #define MAXMBOX         2000
 #define MAXSLOTS        2500
 #define MAX_MESSAGE     150  // largest possible message in a single slot
+#define MAXRECVANY      16   // most mailboxes one MboxRecvAny can wait on
+
+// message priorities, each with its own lane in every mailbox
+#define MBOX_NUM_PRI    4    // priorities run from 0 (most urgent) to 3
+#define MBOX_PRI_NORMAL 3    // the priority of messages sent by MboxSend
+
+// how a mailbox orders the processes waiting to send to or receive from it
+#define MBOX_FIFO       0    // in order of arrival
+#define MBOX_PRIORITY   1    // by priority, in order of arrival within one
+
+// what publishing to a full topic does
+#define TOPIC_DROP_OLDEST 0  // drop its oldest message; laggards get -5
+#define TOPIC_REJECT_NEW  1  // fail the publish with -2
+
+// the order a disk unit serves queued requests in
+#define DISK_FIFO       0    // in order of arrival
+#define DISK_CLOOK      1    // by track, sweeping up and then jumping back
+
+// one buffer of a message that is gathered from or scattered to many buffers
+struct mbox_iovec {
+    void *base;
+    int   len;
+};
 
 
 
@@ -21,12 +44,24 @@ extern void phase2_init(void);
 // returns id of mailbox, or -1 if no more mailboxes, or -1 if invalid args
 extern int MboxCreate(int slots, int slot_size);
 
+// same as MboxCreate, but waiters are ordered by wait_order (MBOX_FIFO or
+// MBOX_PRIORITY); -1 if invalid args
+extern int MboxCreateOrdered(int slots, int slot_size, int wait_order);
+
+// sets the priority (1 to 5) the calling process waits at in MBOX_PRIORITY
+// mailboxes; returns 0, or -1 if invalid priority
+extern int MboxSetWaitPriority(int priority);
+
 // returns 0 if successful, -1 if invalid arg
 extern int MboxRelease(int mbox_id);
 
 // returns 0 if successful, -1 if invalid args
 extern int MboxSend(int mbox_id, void *msg_ptr, int msg_size);
 
+// same as MboxSend, but the message is received ahead of any message of a
+// less urgent priority; -1 if invalid args or priority
+extern int MboxSendPri(int mbox_id, void *msg_ptr, int msg_size, int pri);
+
 // returns size of received msg if successful, -1 if invalid args
 extern int MboxRecv(int mbox_id, void *msg_ptr, int msg_max_size);
 
@@ -36,11 +71,139 @@ extern int MboxCondSend(int mbox_id, void *msg_ptr, int msg_size);
 // returns 0 if successful, 1 if no msg available, -1 if illegal args
 extern int MboxCondRecv(int mbox_id, void *msg_ptr, int msg_max_size);
 
+// returns # of msgs sent, blocking only for the first; -1 if illegal args
+extern int MboxSendMany(int mbox_id, void *msgs[], int sizes[], int n);
+
+// returns 0 and the # of msgs received in *got, blocking only for the first;
+// the length of each msg is written back into maxsizes; -1 if illegal args
+extern int MboxRecvMany(int mbox_id, void *bufs[], int maxsizes[], int n,
+                        int *got);
+
+// same as MboxSend, but the message is gathered from iovcnt buffers
+extern int MboxSendV(int mbox_id, const struct mbox_iovec *iov, int iovcnt);
+
+// same as MboxRecv, but the message is scattered across iovcnt buffers
+extern int MboxRecvV(int mbox_id, const struct mbox_iovec *iov, int iovcnt);
+
+// prints the pages and usage of each message payload size class
+extern void dumpSlabs(void);
+
+// prints the usage statistics of every mailbox and of the slot pool
+extern void dumpMailboxes(void);
+
+// returns size of msg received from whichever of the n mailboxes has one
+// first, and puts that mailbox's id in *which; -1 if invalid args,
+// -3 if the mailbox in *which was released
+extern int MboxRecvAny(int ids[], int n, int *which, void *msg_ptr,
+                       int msg_max_size);
+
+// same as MboxSend, but gives up after timeout_usecs (rounded up to whole
+// clock ticks); returns -4 if the timeout ran out
+extern int MboxSendTimeout(int mbox_id, void *msg_ptr, int msg_size,
+                           int timeout_usecs);
+
+// same as MboxRecv, but gives up after timeout_usecs (rounded up to whole
+// clock ticks); returns -4 if the timeout ran out
+extern int MboxRecvTimeout(int mbox_id, void *msg_ptr, int msg_max_size,
+                           int timeout_usecs);
+
+// blocks for at least usecs, rounded up to whole clock ticks; returns 0,
+// or -1 if usecs is negative
+extern int kernSleep(int usecs);
+
+// sends the clock tick count (an int) to mbox_id every period_usecs; returns
+// the timer id, or -1 if invalid args or no more timers
+extern int kernTimerStart(int period_usecs, int mbox_id);
+
+// returns 0 if the periodic timer was stopped, -1 if invalid id
+extern int kernTimerStop(int timer_id);
+
+// returns id of a topic mailbox keeping up to depth messages, or -1 if
+// invalid args or no more topics
+extern int MboxCreateTopic(int depth, int slot_size, int lag_policy);
+
+// returns a subscriber id for the topic, or -1 if invalid args
+extern int MboxSubscribe(int topic_id);
+
+// returns 0 if successful, -1 if invalid args
+extern int MboxUnsubscribe(int topic_id, int sub_id);
+
+// returns 0 if published to every subscriber, -2 if the topic is full and
+// rejects new messages or no slots are left, -1 if invalid args
+extern int MboxPublish(int topic_id, void *msg_ptr, int msg_size);
+
+// returns size of the subscriber's next msg, blocking until there is one;
+// -5 if it lagged and lost msgs, -3 if released, -1 if invalid args
+extern int MboxRecvTopic(int topic_id, int sub_id, void *msg_ptr,
+                         int msg_max_size);
+
+// turns the mailbox event trace on (1) or off (0); returns the old setting
+extern int traceEnable(int enable);
+
+// writes the trace ring to a host file as Chrome trace-event JSON; returns
+// the number of events written, or -1 if the file could not be opened
+extern int traceExport(char *path);
+
+// returns # of blocks measured on the mailbox (-1 for all mailboxes) and
+// their p50, p99 and max in usecs; -1 if invalid args or stats compiled out
+extern int MboxBlockLatency(int mbox_id, int *p50, int *p99, int *max);
+
+// forgets the mailbox's block durations (-1 for the global ones); returns
+// 0 if successful, -1 if invalid args or stats compiled out
+extern int MboxResetLatency(int mbox_id);
+
 // type = interrupt device type, unit = # of device (when more than one),
 // status = where interrupt handler puts device's status register.
 extern void     waitDevice(int type, int unit, int *status);
 extern void wakeupByDevice(int type, int unit, int status);
 
+// wait for a terminal to receive a character, or to finish sending one;
+// either one splits the terminal's statuses into the two channels
+extern void waitDeviceRx(int unit, int *status);
+extern void waitDeviceTx(int unit, int *status);
+
+// reads or writes (op = USLOSS_DISK_READ or USLOSS_DISK_WRITE) sectors of
+// one track through the unit's request queue; returns 0 if successful, the
+// disk's error status if it failed, -1 if invalid args
+extern int diskRequest(int unit, int op, int track, int first_sector,
+                       int sectors, void *buf);
+
+// sets the unit's DISK_FIFO or DISK_CLOOK order; returns 0 if successful,
+// -1 if invalid args
+extern int diskSetPolicy(int unit, int policy);
+
+// returns 0 and the unit's seeks, tracks crossed and merged requests so
+// far, or -1 if invalid args
+extern int diskStats(int unit, int *seeks, int *tracks, int *merged);
+
+// sets how many statuses a terminal or disk unit queues for waitDevice;
+// returns 0 if successful, -1 if invalid args
+extern int waitDeviceDepth(int type, int unit, int depth);
+
+// returns # of statuses the unit dropped because its queue was full, or
+// -1 if invalid args
+extern int waitDeviceOverflows(int type, int unit);
+
+// puts a terminal in line mode and returns the id of the mailbox its
+// finished lines are sent to; -1 if invalid args, -2 if no mailboxes left
+extern int termLineMailbox(int unit);
+
+// returns # of lines the terminal dropped because its line mailbox was
+// full, or -1 if invalid args
+extern int termLinesLost(int unit);
+
+// queues a line of up to MAXLINE chars to be sent to the terminal; returns
+// len, -1 if invalid args, -2 if no mailboxes left
+extern int termWrite(int unit, char *buf, int len);
+
+// blocks until the lines written to the terminal so far are sent; returns
+// 0 if successful, -1 if invalid args
+extern int termFlush(int unit);
+
+// turns the terminal's receive interrupts on (1) or off (0), and keeps them
+// that way while termWrite output is sent; -1 if invalid args
+extern int termRecvInt(int unit, int on);
+
 // 
 extern void (*systemCallVec[])(USLOSS_Sysargs *args);
 
@@ -72,6 +72,8 @@ void phase5_start_service_processes()
 
 void finish(int argc, char **argv)
 {
+    /* writes nothing unless the testcase turned tracing on */
+    traceExport("phase2_trace.json");
     USLOSS_Console("%s(): The simulation is now terminating.\n", __func__);
 }
 
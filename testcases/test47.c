@@ -0,0 +1,47 @@
+/* start2 sends binary messages that contain zero bytes through a mailbox
+ * and checks that they come back byte-for-byte, with MboxRecv returning
+ * the length that was sent.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+
+
+int start2(char *arg)
+{
+    int mbox_id;
+    int result;
+    int sent[2] = { 0, 0x00ff0000 };
+    int received[2];
+    char buffer[MAX_MESSAGE];
+
+    /* BUGFIX: initialize buffers to predictable contents */
+    memset(received, 0x55, sizeof(received));
+    memset(buffer, 'x', sizeof(buffer));
+
+    USLOSS_Console("start2(): started\n");
+
+    mbox_id = MboxCreate(2, sizeof(sent));
+    USLOSS_Console("start2(): MboxCreate returned id = %d\n", mbox_id);
+
+    result = MboxSend(mbox_id, sent, sizeof(sent));
+    USLOSS_Console("start2(): MboxSend of 2 ints rc %d\n", result);
+
+    result = MboxSend(mbox_id, "ab\0cd", 5);
+    USLOSS_Console("start2(): MboxSend of 5 chars rc %d\n", result);
+
+    result = MboxRecv(mbox_id, received, sizeof(received));
+    USLOSS_Console("start2(): MboxRecv rc %d   ints match: %s\n", result,
+                   memcmp(sent, received, sizeof(sent)) == 0 ? "yes" : "no");
+
+    result = MboxRecv(mbox_id, buffer, sizeof(buffer));
+    USLOSS_Console("start2(): MboxRecv rc %d   chars match: %s   untouched byte: '%c'\n",
+                   result, memcmp(buffer, "ab\0cd", 5) == 0 ? "yes" : "no", buffer[5]);
+
+    quit(0);
+}
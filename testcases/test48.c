@@ -0,0 +1,47 @@
+/* start2 sends a batch of messages with MboxSendMany to a mailbox that
+ * does not have room for all of them, then drains the mailbox with
+ * MboxRecvMany and prints what was received.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+
+
+int start2(char *arg)
+{
+    int mbox_id;
+    int result, got, i;
+    void *msgs[5] = { "one", "two", "three", "four", "five" };
+    int sizes[5] = { 4, 4, 6, 5, 5 };
+    char buffers[5][20];
+    void *bufs[5];
+    int maxsizes[5];
+
+    USLOSS_Console("start2(): started\n");
+
+    mbox_id = MboxCreate(3, 20);
+    USLOSS_Console("start2(): MboxCreate returned id = %d\n", mbox_id);
+
+    result = MboxSendMany(mbox_id, msgs, sizes, 5);
+    USLOSS_Console("start2(): MboxSendMany of 5 messages rc %d\n", result);
+
+    for (i = 0; i < 5; i++) {
+        bufs[i] = buffers[i];
+        maxsizes[i] = sizeof(buffers[i]);
+    }
+    result = MboxRecvMany(mbox_id, bufs, maxsizes, 5, &got);
+    USLOSS_Console("start2(): MboxRecvMany rc %d   got %d\n", result, got);
+    for (i = 0; i < got; i++) {
+        USLOSS_Console("start2(): message %d   size %d   '%s'\n", i, maxsizes[i], buffers[i]);
+    }
+
+    result = MboxCondRecv(mbox_id, buffers[0], sizeof(buffers[0]));
+    USLOSS_Console("start2(): MboxCondRecv on the empty mailbox rc %d\n", result);
+
+    quit(0);
+}
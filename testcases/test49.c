@@ -0,0 +1,65 @@
+/* start2 sends a message gathered from a header struct and a payload
+ * string with MboxSendV, then receives it with MboxRecvV scattered into
+ * a separate header struct and payload buffer.  A second message is too
+ * big for the receive buffers and should return -1.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+struct header {
+    int type;
+    int length;
+};
+
+
+
+int start2(char *arg)
+{
+    int mbox_id;
+    int result;
+    struct header sendHdr, recvHdr;
+    char payload[40];
+    struct mbox_iovec iov[2];
+
+    /* BUGFIX: initialize buffers to predictable contents */
+    memset(&recvHdr, 0, sizeof(recvHdr));
+    memset(payload, 'x', sizeof(payload)-1);
+    payload[sizeof(payload)-1] = '\0';
+
+    USLOSS_Console("start2(): started\n");
+
+    mbox_id = MboxCreate(2, 50);
+    USLOSS_Console("start2(): MboxCreate returned id = %d\n", mbox_id);
+
+    sendHdr.type = 7;
+    sendHdr.length = 12;
+    iov[0].base = &sendHdr;
+    iov[0].len  = sizeof(sendHdr);
+    iov[1].base = "hello there";
+    iov[1].len  = 12;
+    result = MboxSendV(mbox_id, iov, 2);
+    USLOSS_Console("start2(): MboxSendV rc %d\n", result);
+
+    iov[1].base = "this payload is too long for the buffer";
+    iov[1].len  = 40;
+    result = MboxSendV(mbox_id, iov, 2);
+    USLOSS_Console("start2(): MboxSendV rc %d\n", result);
+
+    iov[0].base = &recvHdr;
+    iov[0].len  = sizeof(recvHdr);
+    iov[1].base = payload;
+    iov[1].len  = 20;
+    result = MboxRecvV(mbox_id, iov, 2);
+    USLOSS_Console("start2(): MboxRecvV rc %d   type %d   length %d   payload '%s'\n",
+                   result, recvHdr.type, recvHdr.length, payload);
+
+    result = MboxRecvV(mbox_id, iov, 2);
+    USLOSS_Console("start2(): MboxRecvV rc %d\n", result);
+
+    quit(0);
+}
@@ -0,0 +1,47 @@
+/* start2 creates three mailboxes and sends a message to the last two of
+ * them, then calls MboxRecvAny on all three.  The messages should come back
+ * in mailbox order, and a bad mailbox count should return -1.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+
+
+int start2(char *arg)
+{
+    int ids[3];
+    int i, result, which;
+    char buffer[MAX_MESSAGE];
+
+    /* BUGFIX: initialize buffers to predictable contents */
+    memset(buffer, 'x', sizeof(buffer)-1);
+    buffer[sizeof(buffer)-1] = '\0';
+
+    USLOSS_Console("start2(): started\n");
+
+    for (i = 0; i < 3; i++) {
+        ids[i] = MboxCreate(2, 50);
+        USLOSS_Console("start2(): MboxCreate returned id = %d\n", ids[i]);
+    }
+
+    result = MboxSend(ids[2], "to the third mailbox", 21);
+    USLOSS_Console("start2(): MboxSend to mailbox %d rc %d\n", ids[2], result);
+    result = MboxSend(ids[1], "to the second mailbox", 22);
+    USLOSS_Console("start2(): MboxSend to mailbox %d rc %d\n", ids[1], result);
+
+    for (i = 0; i < 2; i++) {
+        which = -1;
+        result = MboxRecvAny(ids, 3, &which, buffer, sizeof(buffer));
+        USLOSS_Console("start2(): MboxRecvAny rc %d   from mailbox %d   message '%s'\n", result, which, buffer);
+    }
+
+    result = MboxRecvAny(ids, 0, &which, buffer, sizeof(buffer));
+    USLOSS_Console("start2(): MboxRecvAny with no mailboxes rc %d\n", result);
+
+    quit(0);
+}
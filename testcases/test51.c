@@ -0,0 +1,94 @@
+/* start2 times out receiving from an empty mailbox, then receives a message
+ * that XXp1 sends before the timeout runs out.  It fills the mailbox and
+ * times out sending to it.  XXp2a and XXp2b then both block sending to the
+ * full mailbox; XXp2b, behind XXp2a in the queue, times out first, and
+ * XXp2a's message is still delivered once start2 makes room.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp1(char *);
+int XXp2(char *);
+
+int mbox_id, sleep_id;
+
+
+
+int start2(char *arg)
+{
+    int kid_status, kidpid, result;
+    char buffer[50];
+
+    USLOSS_Console("start2(): started\n");
+    mbox_id  = MboxCreate(1, 50);
+    sleep_id = MboxCreate(0, 0);
+    USLOSS_Console("start2(): MboxCreate returned ids %d and %d\n", mbox_id, sleep_id);
+
+    result = MboxRecvTimeout(mbox_id, buffer, 50, 50000);
+    USLOSS_Console("start2(): MboxRecvTimeout on empty mailbox rc %d\n", result);
+
+    result = MboxRecvTimeout(mbox_id, buffer, 50, 0);
+    USLOSS_Console("start2(): MboxRecvTimeout with zero timeout rc %d\n", result);
+
+    kidpid = fork1("XXp1", XXp1, NULL, 2 * USLOSS_MIN_STACK, 4);
+    result = MboxRecvTimeout(mbox_id, buffer, 50, 1000000);
+    USLOSS_Console("start2(): MboxRecvTimeout rc %d   message '%s'\n", result, buffer);
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+
+    result = MboxSend(mbox_id, "first", 6);
+    USLOSS_Console("start2(): MboxSend rc %d\n", result);
+    result = MboxSendTimeout(mbox_id, "too many", 9, 50000);
+    USLOSS_Console("start2(): MboxSendTimeout on full mailbox rc %d\n", result);
+
+    kidpid = fork1("XXp2a", XXp2, "1000000", 2 * USLOSS_MIN_STACK, 2);
+    kidpid = fork1("XXp2b", XXp2, "100000",  2 * USLOSS_MIN_STACK, 2);
+
+    result = MboxRecvTimeout(sleep_id, NULL, 0, 300000);
+    USLOSS_Console("start2(): done sleeping, rc %d\n", result);
+
+    result = MboxRecv(mbox_id, buffer, 50);
+    USLOSS_Console("start2(): MboxRecv rc %d   message '%s'\n", result, buffer);
+    result = MboxRecv(mbox_id, buffer, 50);
+    USLOSS_Console("start2(): MboxRecv rc %d   message '%s'\n", result, buffer);
+
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+
+    quit(0);
+}
+
+
+int XXp1(char *arg)
+{
+    int result;
+
+    USLOSS_Console("XXp1(): sending to mailbox %d\n", mbox_id);
+    result = MboxSend(mbox_id, "in time", 8);
+    USLOSS_Console("XXp1(): MboxSend rc %d\n", result);
+
+    quit(3);
+}
+
+
+int XXp2(char *arg)
+{
+    int result;
+    char buffer[20];
+    int timeout = atoi(arg);
+
+    sprintf(buffer, "waited %d", timeout);
+    USLOSS_Console("XXp2(): sending '%s' to mailbox %d\n", buffer, mbox_id);
+    result = MboxSendTimeout(mbox_id, buffer, strlen(buffer)+1, timeout);
+    USLOSS_Console("XXp2(): MboxSendTimeout of '%s' rc %d\n", buffer, result);
+
+    quit(4);
+}
@@ -0,0 +1,78 @@
+/* XXp1 sleeps for 300 ms and XXp2 for 100 ms; XXp2 should wake first even
+ * though it went to sleep last.  start2 then sleeps for two seconds, long
+ * enough to pass through the upper levels of the timer wheel, and starts a
+ * periodic timer that sends the tick count to a mailbox every 40 ms (two
+ * clock ticks).
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp1(char *);
+int XXp2(char *);
+
+
+
+int start2(char *arg)
+{
+    int kid_status, kidpid, result, mbox_id, timer_id, i;
+    int start, tick, lastTick = -1;
+
+    USLOSS_Console("start2(): started\n");
+
+    kidpid = fork1("XXp1", XXp1, NULL, 2 * USLOSS_MIN_STACK, 2);
+    kidpid = fork1("XXp2", XXp2, NULL, 2 * USLOSS_MIN_STACK, 2);
+
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+
+    start = currentTime();
+    result = kernSleep(2000000);
+    USLOSS_Console("start2(): kernSleep rc %d   slept at least 2 seconds: %d\n", result, currentTime() - start >= 2000000);
+    USLOSS_Console("start2(): kernSleep with negative time rc %d\n", kernSleep(-1));
+
+    mbox_id = MboxCreate(5, sizeof(int));
+    timer_id = kernTimerStart(40000, mbox_id);
+    USLOSS_Console("start2(): kernTimerStart rc %d\n", timer_id);
+
+    for (i = 0; i < 3; i++) {
+        result = MboxRecv(mbox_id, &tick, sizeof(int));
+        if (lastTick != -1) {
+            USLOSS_Console("start2(): periodic timer fired %d ticks after the last time\n", tick - lastTick);
+        }
+        lastTick = tick;
+    }
+
+    result = kernTimerStop(timer_id);
+    USLOSS_Console("start2(): kernTimerStop rc %d\n", result);
+    result = kernTimerStop(timer_id);
+    USLOSS_Console("start2(): kernTimerStop again rc %d\n", result);
+
+    quit(0);
+}
+
+
+int XXp1(char *arg)
+{
+    USLOSS_Console("XXp1(): going to sleep for 300 ms\n");
+    kernSleep(300000);
+    USLOSS_Console("XXp1(): woke up\n");
+
+    quit(3);
+}
+
+
+int XXp2(char *arg)
+{
+    USLOSS_Console("XXp2(): going to sleep for 100 ms\n");
+    kernSleep(100000);
+    USLOSS_Console("XXp2(): woke up\n");
+
+    quit(4);
+}
@@ -0,0 +1,69 @@
+/* start2 creates 40 children that all call waitDevice for the clock at
+ * once.  All of them should be woken by the same clock interrupt, and get
+ * the same status, rather than one of them per 100 ms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+#define NUM_WAITERS 40
+
+int XXp1(char *);
+
+int wakeTimes[NUM_WAITERS];
+int statuses[NUM_WAITERS];
+
+
+
+int start2(char *arg)
+{
+    int kid_status, kidpid, i;
+    int earliest, latest, sameStatus = 1;
+    char name[16], index[16];
+
+    USLOSS_Console("start2(): started\n");
+
+    for (i = 0; i < NUM_WAITERS; i++) {
+        sprintf(name, "XXp1-%d", i);
+        sprintf(index, "%d", i);
+        kidpid = fork1(name, XXp1, index, 2 * USLOSS_MIN_STACK, 2);
+    }
+
+    for (i = 0; i < NUM_WAITERS; i++) {
+        kidpid = join(&kid_status);
+    }
+    USLOSS_Console("start2(): joined with all %d waiters\n", NUM_WAITERS);
+
+    earliest = latest = wakeTimes[0];
+    for (i = 1; i < NUM_WAITERS; i++) {
+        if (wakeTimes[i] < earliest) {
+            earliest = wakeTimes[i];
+        }
+        if (wakeTimes[i] > latest) {
+            latest = wakeTimes[i];
+        }
+        if (statuses[i] != statuses[0]) {
+            sameStatus = 0;
+        }
+    }
+    USLOSS_Console("start2(): all waiters woke within one clock period: %d\n", latest - earliest < 100000);
+    USLOSS_Console("start2(): all waiters got the same status: %d\n", sameStatus);
+
+    quit(0);
+}
+
+
+int XXp1(char *arg)
+{
+    int i = atoi(arg);
+
+    waitDevice(USLOSS_CLOCK_DEV, 0, &statuses[i]);
+    wakeTimes[i] = currentTime();
+
+    quit(i);
+}
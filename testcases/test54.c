@@ -0,0 +1,63 @@
+/* XXp1 and XXp2 each block receiving from their own zero-slot mailbox.
+ * start2 runs at a higher priority and does a conditional send to each
+ * mailbox before either receiver gets to run.  The consumer woken on the
+ * first mailbox must not keep the second rendezvous from happening, so
+ * both sends should succeed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp1(char *);
+
+int mbox_ids[2];
+
+
+
+int start2(char *arg)
+{
+    int kid_status, kidpid, result, i;
+
+    USLOSS_Console("start2(): started\n");
+
+    for (i = 0; i < 2; i++) {
+        mbox_ids[i] = MboxCreate(0, 0);
+        USLOSS_Console("start2(): MboxCreate returned id = %d\n", mbox_ids[i]);
+    }
+
+    kidpid = fork1("XXp1a", XXp1, "0", 2 * USLOSS_MIN_STACK, 3);
+    kidpid = fork1("XXp1b", XXp1, "1", 2 * USLOSS_MIN_STACK, 3);
+
+    /* let both receivers block */
+    kernSleep(20000);
+
+    for (i = 0; i < 2; i++) {
+        result = MboxCondSend(mbox_ids[i], NULL, 0);
+        USLOSS_Console("start2(): MboxCondSend to mailbox %d rc %d\n", mbox_ids[i], result);
+    }
+
+    for (i = 0; i < 2; i++) {
+        kidpid = join(&kid_status);
+        USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+    }
+
+    quit(0);
+}
+
+
+int XXp1(char *arg)
+{
+    int i = atoi(arg);
+    int result;
+
+    USLOSS_Console("XXp1(): receiving from mailbox %d\n", mbox_ids[i]);
+    result = MboxRecv(mbox_ids[i], NULL, 0);
+    USLOSS_Console("XXp1(): MboxRecv from mailbox %d rc %d\n", mbox_ids[i], result);
+
+    quit(3 + i);
+}
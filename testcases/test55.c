@@ -0,0 +1,73 @@
+/* Three receivers, at priorities 5, 2 and 3, block on a mailbox one after
+ * another.  start2 then sends three messages.  On an MBOX_FIFO mailbox the
+ * receivers get the messages in the order they arrived; on an MBOX_PRIORITY
+ * mailbox the priority 2 receiver goes first and the priority 5 one last.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp1(char *);
+
+int mbox_id;
+
+
+
+void runReceivers(void)
+{
+    int kid_status, kidpid, i;
+    char buffer[20];
+    char *priorities[] = { "5", "2", "3" };
+
+    for (i = 0; i < 3; i++) {
+        kidpid = fork1("XXp1", XXp1, priorities[i], 2 * USLOSS_MIN_STACK, atoi(priorities[i]));
+        kernSleep(1);
+    }
+
+    for (i = 0; i < 3; i++) {
+        sprintf(buffer, "message #%d", i);
+        MboxSend(mbox_id, buffer, strlen(buffer)+1);
+    }
+
+    for (i = 0; i < 3; i++) {
+        kidpid = join(&kid_status);
+    }
+}
+
+
+int start2(char *arg)
+{
+    USLOSS_Console("start2(): started\n");
+
+    mbox_id = MboxCreateOrdered(5, 50, MBOX_FIFO);
+    USLOSS_Console("start2(): MboxCreateOrdered FIFO returned id = %d\n", mbox_id);
+    runReceivers();
+
+    mbox_id = MboxCreateOrdered(5, 50, MBOX_PRIORITY);
+    USLOSS_Console("start2(): MboxCreateOrdered PRIORITY returned id = %d\n", mbox_id);
+    runReceivers();
+
+    USLOSS_Console("start2(): MboxCreateOrdered with a bad order rc %d\n", MboxCreateOrdered(5, 50, 2));
+    USLOSS_Console("start2(): MboxSetWaitPriority(6) rc %d\n", MboxSetWaitPriority(6));
+
+    quit(0);
+}
+
+
+int XXp1(char *arg)
+{
+    char buffer[50];
+    int result;
+
+    MboxSetWaitPriority(atoi(arg));
+    USLOSS_Console("XXp1(): priority %s receiving from mailbox %d\n", arg, mbox_id);
+    result = MboxRecv(mbox_id, buffer, sizeof(buffer));
+    USLOSS_Console("XXp1(): priority %s received rc %d   message '%s'\n", arg, result, buffer);
+
+    quit(3);
+}
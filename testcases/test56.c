@@ -0,0 +1,46 @@
+/* start2 queues three ordinary messages, then sends messages at priorities
+ * 0, 1 and 0 with MboxSendPri.  The receives should return the two
+ * priority 0 messages first, in the order they were sent, then the priority
+ * 1 message, then the ordinary ones.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+
+
+int start2(char *arg)
+{
+    int mbox_id, result, i;
+    char buffer[50];
+
+    USLOSS_Console("start2(): started\n");
+    mbox_id = MboxCreate(10, 50);
+    USLOSS_Console("start2(): MboxCreate returned id = %d\n", mbox_id);
+
+    for (i = 0; i < 3; i++) {
+        sprintf(buffer, "data #%d", i);
+        result = MboxSend(mbox_id, buffer, strlen(buffer)+1);
+        USLOSS_Console("start2(): MboxSend of '%s' rc %d\n", buffer, result);
+    }
+
+    result = MboxSendPri(mbox_id, "shutdown", 9, 0);
+    USLOSS_Console("start2(): MboxSendPri of 'shutdown' at priority 0 rc %d\n", result);
+    result = MboxSendPri(mbox_id, "reload", 7, 1);
+    USLOSS_Console("start2(): MboxSendPri of 'reload' at priority 1 rc %d\n", result);
+    result = MboxSendPri(mbox_id, "abort", 6, 0);
+    USLOSS_Console("start2(): MboxSendPri of 'abort' at priority 0 rc %d\n", result);
+    result = MboxSendPri(mbox_id, "bad", 4, MBOX_NUM_PRI);
+    USLOSS_Console("start2(): MboxSendPri at priority %d rc %d\n", MBOX_NUM_PRI, result);
+
+    for (i = 0; i < 6; i++) {
+        result = MboxRecv(mbox_id, buffer, sizeof(buffer));
+        USLOSS_Console("start2(): MboxRecv rc %d   message '%s'\n", result, buffer);
+    }
+
+    quit(0);
+}
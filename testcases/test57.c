@@ -0,0 +1,95 @@
+/* A topic keeping three messages has two subscribers.  XXp1 reads its
+ * subscription as each message is published; start2 only reads its own
+ * after publishing five, so the two oldest have been dropped and it should
+ * first get -5.  A second topic rejects new messages when full.  Finally
+ * XXp1 blocks on the first topic and is woken with -3 when it is released.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp1(char *);
+
+int topic_id, sub_fast;
+
+
+
+int start2(char *arg)
+{
+    int kid_status, kidpid, result, i, sub_slow, other_id, other_sub;
+    char buffer[50];
+    char *words[] = { "one", "two", "three", "four", "five" };
+
+    USLOSS_Console("start2(): started\n");
+    topic_id = MboxCreateTopic(3, 50, TOPIC_DROP_OLDEST);
+    USLOSS_Console("start2(): MboxCreateTopic returned id = %d\n", topic_id);
+
+    sub_fast = MboxSubscribe(topic_id);
+    sub_slow = MboxSubscribe(topic_id);
+    USLOSS_Console("start2(): MboxSubscribe returned %d and %d\n", sub_fast, sub_slow);
+
+    kidpid = fork1("XXp1", XXp1, NULL, 2 * USLOSS_MIN_STACK, 2);
+    kernSleep(1);
+
+    for (i = 0; i < 5; i++) {
+        result = MboxPublish(topic_id, words[i], strlen(words[i])+1);
+        USLOSS_Console("start2(): MboxPublish of '%s' rc %d\n", words[i], result);
+        kernSleep(1);
+    }
+
+    result = MboxSend(topic_id, "not a topic op", 15);
+    USLOSS_Console("start2(): MboxSend to the topic rc %d\n", result);
+
+    for (i = 0; i < 4; i++) {
+        result = MboxRecvTopic(topic_id, sub_slow, buffer, sizeof(buffer));
+        if (result < 0) {
+            USLOSS_Console("start2(): MboxRecvTopic rc %d\n", result);
+        }
+        else {
+            USLOSS_Console("start2(): MboxRecvTopic rc %d   message '%s'\n", result, buffer);
+        }
+    }
+
+    other_id = MboxCreateTopic(2, 50, TOPIC_REJECT_NEW);
+    other_sub = MboxSubscribe(other_id);
+    for (i = 0; i < 3; i++) {
+        result = MboxPublish(other_id, words[i], strlen(words[i])+1);
+        USLOSS_Console("start2(): MboxPublish of '%s' to topic %d rc %d\n", words[i], other_id, result);
+    }
+    result = MboxRecvTopic(other_id, other_sub, buffer, sizeof(buffer));
+    USLOSS_Console("start2(): MboxRecvTopic rc %d   message '%s'\n", result, buffer);
+    result = MboxUnsubscribe(other_id, other_sub);
+    USLOSS_Console("start2(): MboxUnsubscribe rc %d\n", result);
+    result = MboxRelease(other_id);
+    USLOSS_Console("start2(): MboxRelease of topic %d rc %d\n", other_id, result);
+
+    result = MboxRelease(topic_id);
+    USLOSS_Console("start2(): MboxRelease of topic %d rc %d\n", topic_id, result);
+
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+
+    quit(0);
+}
+
+
+int XXp1(char *arg)
+{
+    int result;
+    char buffer[50];
+
+    while (1) {
+        result = MboxRecvTopic(topic_id, sub_fast, buffer, sizeof(buffer));
+        if (result < 0) {
+            USLOSS_Console("XXp1(): MboxRecvTopic rc %d\n", result);
+            break;
+        }
+        USLOSS_Console("XXp1(): MboxRecvTopic rc %d   message '%s'\n", result, buffer);
+    }
+
+    quit(3);
+}
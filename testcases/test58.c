@@ -0,0 +1,82 @@
+/* Exercises the mailbox statistics.  start2 fills a two slot mailbox,
+ * fails a conditional send, and then blocks sending a third message until
+ * XXp1 drains the mailbox.  A second mailbox is released while XXp1 is
+ * blocked receiving on it.  dumpMailboxes() is called before and after.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp1(char *);
+int XXp2(char *);
+
+int mbox_id, idle_id;
+
+
+
+int start2(char *arg)
+{
+    int kid_status, kidpid, result;
+
+    USLOSS_Console("start2(): started\n");
+    mbox_id = MboxCreate(2, 50);
+    idle_id = MboxCreate(1, 50);
+    USLOSS_Console("start2(): created mailboxes %d and %d\n", mbox_id, idle_id);
+
+    MboxSend(mbox_id, "hello", 6);
+    MboxSend(mbox_id, "there", 6);
+    result = MboxCondSend(mbox_id, "full", 5);
+    USLOSS_Console("start2(): MboxCondSend returned %d\n", result);
+
+    dumpMailboxes();
+
+    kidpid = fork1("XXp1", XXp1, NULL, 2 * USLOSS_MIN_STACK, 3);
+    MboxSend(mbox_id, "world", 6);
+    USLOSS_Console("start2(): third MboxSend done\n");
+
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+
+    kidpid = fork1("XXp2", XXp2, NULL, 2 * USLOSS_MIN_STACK, 3);
+    kernSleep(1);
+    MboxRelease(idle_id);
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+
+    dumpMailboxes();
+
+    quit(0);
+    return 0;
+}
+
+int XXp1(char *arg)
+{
+    char buffer[50];
+    int i, result;
+
+    for (i = 0; i < 3; i++) {
+        result = MboxRecv(mbox_id, buffer, 50);
+        USLOSS_Console("XXp1(): received %d bytes '%s'\n", result, buffer);
+    }
+    result = MboxCondRecv(mbox_id, buffer, 50);
+    USLOSS_Console("XXp1(): MboxCondRecv returned %d\n", result);
+
+    quit(1);
+    return 1;
+}
+
+int XXp2(char *arg)
+{
+    char buffer[50];
+    int result;
+
+    result = MboxRecv(idle_id, buffer, 50);
+    USLOSS_Console("XXp2(): MboxRecv returned %d\n", result);
+
+    quit(2);
+    return 2;
+}
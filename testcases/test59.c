@@ -0,0 +1,83 @@
+/* Records a short run in the trace ring and exports it.  start2 turns
+ * tracing on, fills a one slot mailbox, and blocks sending a second message
+ * until XXp1 receives the first.  Tracing is turned off before a last send,
+ * which must not show up.  The exported file is printed back with each
+ * timestamp masked, since they depend on the clock, and the timestamps are
+ * only checked to never go down.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp1(char *);
+
+int mbox_id;
+
+
+
+int start2(char *arg)
+{
+    int kid_status, kidpid, result, ts, lastTs = -1, ordered = 1;
+    char line[200], *tsField, *rest;
+    FILE *file;
+
+    USLOSS_Console("start2(): started\n");
+    mbox_id = MboxCreate(1, 50);
+
+    result = traceEnable(1);
+    USLOSS_Console("start2(): traceEnable(1) returned %d\n", result);
+
+    kidpid = fork1("XXp1", XXp1, NULL, 2 * USLOSS_MIN_STACK, 3);
+    MboxSend(mbox_id, "hello", 6);
+    MboxSend(mbox_id, "world", 6);
+    kidpid = join(&kid_status);
+    MboxRelease(mbox_id);
+
+    result = traceEnable(0);
+    USLOSS_Console("start2(): traceEnable(0) returned %d\n", result);
+    MboxCondSend(mbox_id, "ignored", 8);
+
+    result = traceExport("test59_trace.json");
+    USLOSS_Console("start2(): traceExport returned %d\n", result);
+
+    file = fopen("test59_trace.json", "r");
+    while (fgets(line, sizeof(line), file) != NULL) {
+        tsField = strstr(line, "\"ts\":");
+        if (tsField == NULL) {
+            USLOSS_Console("%s", line);
+            continue;
+        }
+        tsField += strlen("\"ts\":");
+        ts = strtol(tsField, &rest, 10);
+        if (ts < lastTs) {
+            ordered = 0;
+        }
+        lastTs = ts;
+        *tsField = '\0';
+        USLOSS_Console("%sT%s", line, rest);
+    }
+    fclose(file);
+    USLOSS_Console("start2(): timestamps never go down: %d\n", ordered);
+
+    quit(0);
+    return 0;
+}
+
+int XXp1(char *arg)
+{
+    char buffer[50];
+    int result;
+
+    result = MboxRecv(mbox_id, buffer, 50);
+    USLOSS_Console("XXp1(): received %d bytes '%s'\n", result, buffer);
+    result = MboxRecv(mbox_id, buffer, 50);
+    USLOSS_Console("XXp1(): received %d bytes '%s'\n", result, buffer);
+
+    quit(1);
+    return 1;
+}
@@ -0,0 +1,86 @@
+/* Measures how long processes block on a mailbox.  XXp1 receives from an
+ * empty mailbox three times, and start2 sleeps a tenth of a second before
+ * each send, so each block is at least that long.  start2 then blocks once
+ * as a producer on a second mailbox.  The histograms are checked and then
+ * reset.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp1(char *);
+
+int mbox_id, full_id;
+
+
+
+void report(char *name, int id)
+{
+    int samples, p50, p99, max;
+
+    samples = MboxBlockLatency(id, &p50, &p99, &max);
+    USLOSS_Console("start2(): %s: %d blocks   p50 <= p99 <= max: %d   "
+                   "max at least 100 ms: %d\n", name, samples,
+                   p50 <= p99 && p99 <= max, max >= 100000);
+}
+
+int start2(char *arg)
+{
+    int kid_status, kidpid, i, p50, p99, max;
+    char buffer[50];
+
+    USLOSS_Console("start2(): started\n");
+    mbox_id = MboxCreate(1, 50);
+    full_id = MboxCreate(1, 50);
+
+    kidpid = fork1("XXp1", XXp1, NULL, 2 * USLOSS_MIN_STACK, 2);
+    for (i = 0; i < 3; i++) {
+        kernSleep(100000);
+        MboxSend(mbox_id, "wake", 5);
+    }
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+
+    MboxSend(full_id, "first", 6);
+    kidpid = fork1("XXp2", XXp1, "drain", 2 * USLOSS_MIN_STACK, 3);
+    MboxSend(full_id, "second", 7);
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+    MboxRecv(full_id, buffer, 50);
+
+    report("mailbox", mbox_id);
+    report("all mailboxes", -1);
+    USLOSS_Console("start2(): bad mailbox id rc %d\n", MboxBlockLatency(3000, &p50, &p99, &max));
+
+    USLOSS_Console("start2(): MboxResetLatency rc %d\n", MboxResetLatency(mbox_id));
+    report("mailbox after reset", mbox_id);
+    USLOSS_Console("start2(): all mailboxes still has %d blocks\n", MboxBlockLatency(-1, &p50, &p99, &max));
+    USLOSS_Console("start2(): MboxResetLatency(-1) rc %d\n", MboxResetLatency(-1));
+    USLOSS_Console("start2(): all mailboxes now has %d blocks\n", MboxBlockLatency(-1, &p50, &p99, &max));
+
+    quit(0);
+    return 0;
+}
+
+int XXp1(char *arg)
+{
+    char buffer[50];
+    int i, result;
+
+    if (arg != NULL) {
+        result = MboxRecv(full_id, buffer, 50);
+        USLOSS_Console("XXp2(): received '%s'\n", buffer);
+        quit(2);
+    }
+    for (i = 0; i < 3; i++) {
+        result = MboxRecv(mbox_id, buffer, 50);
+        USLOSS_Console("XXp1(): received %d bytes '%s'\n", result, buffer);
+    }
+
+    quit(1);
+    return 1;
+}
@@ -0,0 +1,61 @@
+/* Tests that terminal statuses are queued for waitDevice.  Receive
+ * interrupts are turned on for terminals 0 and 1, and start2 sleeps until
+ * every character has arrived before calling waitDevice.  Terminal 0 keeps
+ * all of its characters.  Terminal 1 only keeps 8, so the rest overflow.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+
+
+void readTerminal(int unit, int count)
+{
+    int i, status;
+    char line[80];
+
+    for (i = 0; i < count; i++) {
+        waitDevice(USLOSS_TERM_DEV, unit, &status);
+        line[i] = USLOSS_TERM_STAT_CHAR(status);
+        if (line[i] == '\n') {
+            line[i] = '$';
+        }
+    }
+    line[count] = '\0';
+    USLOSS_Console("start2(): terminal %d sent '%s'\n", unit, line);
+}
+
+int start2(char *arg)
+{
+    long control = 0;
+    int  result;
+
+    USLOSS_Console("start2(): started\n");
+
+    USLOSS_Console("start2(): waitDeviceDepth rc %d, bad depth rc %d, bad unit rc %d\n",
+                   waitDeviceDepth(USLOSS_TERM_DEV, 1, 8),
+                   waitDeviceDepth(USLOSS_TERM_DEV, 1, 0),
+                   waitDeviceDepth(USLOSS_TERM_DEV, 4, 8));
+
+    control = USLOSS_TERM_CTRL_RECV_INT(control);
+    USLOSS_DeviceOutput(USLOSS_TERM_DEV, 0, (void *)control);
+    USLOSS_DeviceOutput(USLOSS_TERM_DEV, 1, (void *)control);
+
+    kernSleep(500000);
+
+    readTerminal(0, 5);
+    USLOSS_Console("start2(): terminal 0 overflows: %d\n",
+                   waitDeviceOverflows(USLOSS_TERM_DEV, 0));
+
+    readTerminal(1, 8);
+    result = waitDeviceOverflows(USLOSS_TERM_DEV, 1);
+    USLOSS_Console("start2(): terminal 1 overflows: %d\n", result);
+    USLOSS_Console("start2(): disk 2 overflows rc %d\n",
+                   waitDeviceOverflows(USLOSS_DISK_DEV, 2));
+
+    quit(0);
+    return 0;
+}
@@ -0,0 +1,69 @@
+/* Tests terminal line mode with the term0.in - term3.in fixtures.  Each
+ * terminal is put in line mode, and one reader per terminal receives whole
+ * lines from the terminal's line mailbox until it has read all the lines
+ * of its fixture, and quits with the number of lines it read.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp(char *);
+
+int lineMbox[4];
+int numLines[4] = { 1, 7, 1, 1 };
+
+
+
+int start2(char *arg)
+{
+    int  kid_status, kidpid, i;
+    long control = 0;
+    char name[10], buf[10];
+
+    USLOSS_Console("start2(): started\n");
+    USLOSS_Console("start2(): termLineMailbox(4) rc %d\n", termLineMailbox(4));
+
+    control = USLOSS_TERM_CTRL_RECV_INT(control);
+    for (i = 0; i < 4; i++) {
+        lineMbox[i] = termLineMailbox(i);
+        USLOSS_Console("start2(): terminal %d lines go to mailbox %d\n", i, lineMbox[i]);
+        USLOSS_DeviceOutput(USLOSS_TERM_DEV, i, (void *)control);
+    }
+    USLOSS_Console("start2(): termLineMailbox(0) again rc %d\n", termLineMailbox(0));
+
+    for (i = 0; i < 4; i++) {
+        sprintf(name, "XXp%d", i);
+        sprintf(buf, "%d", i);
+        kidpid = fork1(name, XXp, buf, 2 * USLOSS_MIN_STACK, 2);
+    }
+    for (i = 0; i < 4; i++) {
+        kidpid = join(&kid_status);
+        USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+    }
+
+    for (i = 0; i < 4; i++) {
+        USLOSS_Console("start2(): terminal %d lost %d lines\n", i, termLinesLost(i));
+    }
+
+    quit(0);
+    return 0;
+}
+
+int XXp(char *arg)
+{
+    int terminal = atoi(arg);
+    int i, length;
+    char line[MAXLINE + 1];
+
+    for (i = 0; i < numLines[terminal]; i++) {
+        length = MboxRecv(lineMbox[terminal], line, MAXLINE);
+        line[length - 1] = '\0';
+        USLOSS_Console("XXp%d(): line %d has %d characters: '%s'\n", terminal, i, length, line);
+    }
+
+    quit(numLines[terminal]);
+}
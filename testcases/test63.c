@@ -0,0 +1,62 @@
+/* Tests buffered terminal output.  Two writers each queue three lines for
+ * terminal 2 without waiting for them to be sent, then flush.  The lines
+ * must come out whole.  start2 flushes last, and prints what was written
+ * to term2.out.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp(char *);
+
+
+
+int start2(char *arg)
+{
+    int  kid_status, kidpid, i;
+    char line[MAXLINE + 1];
+    FILE *file;
+
+    USLOSS_Console("start2(): started\n");
+    USLOSS_Console("start2(): termWrite to terminal 4 rc %d\n", termWrite(4, "x", 1));
+    USLOSS_Console("start2(): termWrite too long rc %d\n", termWrite(2, line, MAXLINE + 1));
+    USLOSS_Console("start2(): termFlush with nothing written rc %d\n", termFlush(2));
+
+    kidpid = fork1("XXpA", XXp, "A", 2 * USLOSS_MIN_STACK, 3);
+    kidpid = fork1("XXpB", XXp, "B", 2 * USLOSS_MIN_STACK, 3);
+
+    for (i = 0; i < 2; i++) {
+        kidpid = join(&kid_status);
+        USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+    }
+    termWrite(2, "done\n", 5);
+    USLOSS_Console("start2(): termFlush rc %d\n", termFlush(2));
+
+    file = fopen("term2.out", "r");
+    while (fgets(line, sizeof(line), file) != NULL) {
+        USLOSS_Console("term2.out: %s", line);
+    }
+    fclose(file);
+
+    quit(0);
+    return 0;
+}
+
+int XXp(char *arg)
+{
+    int  i, result;
+    char line[MAXLINE];
+
+    for (i = 0; i < 3; i++) {
+        sprintf(line, "writer %s line %d\n", arg, i);
+        result = termWrite(2, line, strlen(line));
+        USLOSS_Console("XXp%s(): termWrite rc %d\n", arg, result);
+    }
+    result = termFlush(2);
+    USLOSS_Console("XXp%s(): termFlush rc %d\n", arg, result);
+
+    quit(3);
+}
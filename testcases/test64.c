@@ -0,0 +1,90 @@
+/* Tests full-duplex traffic on terminal 1.  XXpRx reads 12 characters with
+ * waitDeviceRx while XXpTx sends a line one character at a time with
+ * waitDeviceTx.  Neither should be woken by the other's interrupts: every
+ * status XXpRx gets has a received character, and every status XXpTx gets
+ * has the transmitter ready.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXpRx(char *);
+int XXpTx(char *);
+
+char *message = "full duplex\n";
+
+
+
+int start2(char *arg)
+{
+    int  kid_status, kidpid, i;
+    long control = 0;
+    char line[80];
+    FILE *file;
+
+    USLOSS_Console("start2(): started\n");
+
+    control = USLOSS_TERM_CTRL_RECV_INT(control);
+    USLOSS_DeviceOutput(USLOSS_TERM_DEV, 1, (void *)control);
+
+    kidpid = fork1("XXpRx", XXpRx, NULL, 2 * USLOSS_MIN_STACK, 2);
+    kidpid = fork1("XXpTx", XXpTx, NULL, 2 * USLOSS_MIN_STACK, 2);
+    for (i = 0; i < 2; i++) {
+        kidpid = join(&kid_status);
+        USLOSS_Console("start2(): joined with kid %d, status = %d\n", kidpid, kid_status);
+    }
+
+    file = fopen("term1.out", "r");
+    while (fgets(line, sizeof(line), file) != NULL) {
+        USLOSS_Console("term1.out: %s", line);
+    }
+    fclose(file);
+
+    quit(0);
+    return 0;
+}
+
+int XXpRx(char *arg)
+{
+    int  i, status, spurious = 0;
+    char received[13];
+
+    for (i = 0; i < 12; i++) {
+        waitDeviceRx(1, &status);
+        if (USLOSS_TERM_STAT_RECV(status) != USLOSS_DEV_BUSY) {
+            spurious++;
+        }
+        received[i] = USLOSS_TERM_STAT_CHAR(status);
+        if (received[i] == '\n') {
+            received[i] = '$';
+        }
+    }
+    received[12] = '\0';
+    USLOSS_Console("XXpRx(): received '%s', spurious wakeups: %d\n", received, spurious);
+
+    quit(1);
+}
+
+int XXpTx(char *arg)
+{
+    int  i, status, spurious = 0;
+    long control;
+
+    for (i = 0; i < strlen(message); i++) {
+        control = USLOSS_TERM_CTRL_RECV_INT(0);
+        control = USLOSS_TERM_CTRL_XMIT_INT(control);
+        control = USLOSS_TERM_CTRL_XMIT_CHAR(control);
+        control = USLOSS_TERM_CTRL_CHAR(control, message[i]);
+        USLOSS_DeviceOutput(USLOSS_TERM_DEV, 1, (void *)control);
+        waitDeviceTx(1, &status);
+        if (USLOSS_TERM_STAT_XMIT(status) != USLOSS_DEV_READY) {
+            spurious++;
+        }
+    }
+    USLOSS_Console("XXpTx(): sent %d characters, spurious wakeups: %d\n", (int)strlen(message), spurious);
+
+    quit(2);
+}
@@ -0,0 +1,80 @@
+/* Compares FIFO and C-LOOK ordering of disk requests.  For each policy,
+ * start2 forks eight readers of scattered tracks on disk 0, which queue up
+ * behind the first one, and then three readers of adjacent sectors of one
+ * track.  The readers report the order they finish in, and start2 the
+ * seeks, tracks crossed and merged requests.  A write is read back first
+ * to check the data.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp(char *);
+
+char *batch[] = { "20 0 1", "3 0 1", "25 0 1", "7 0 1", "18 0 1", "1 0 1",
+                  "30 0 1", "12 0 1", "9 8 4", "9 0 4", "9 4 4" };
+
+
+
+void runBatch(char *name, int policy)
+{
+    int  kid_status, kidpid, i, seeks, tracks, merged;
+    int  seeks0, tracks0, merged0;
+
+    diskStats(0, &seeks0, &tracks0, &merged0);
+    USLOSS_Console("start2(): %s: diskSetPolicy rc %d\n", name, diskSetPolicy(0, policy));
+    for (i = 0; i < 11; i++) {
+        kidpid = fork1("XXp", XXp, batch[i], 2 * USLOSS_MIN_STACK, 2);
+    }
+    for (i = 0; i < 11; i++) {
+        kidpid = join(&kid_status);
+    }
+    diskStats(0, &seeks, &tracks, &merged);
+    USLOSS_Console("start2(): %s: %d seeks, %d tracks crossed, %d merged\n",
+                   name, seeks - seeks0, tracks - tracks0, merged - merged0);
+}
+
+int start2(char *arg)
+{
+    char out[2 * USLOSS_DISK_SECTOR_SIZE], in[2 * USLOSS_DISK_SECTOR_SIZE];
+    int  result, seeks, tracks, merged;
+
+    USLOSS_Console("start2(): started\n");
+    USLOSS_Console("start2(): bad unit rc %d, too many sectors rc %d, bad policy rc %d\n",
+                   diskRequest(2, USLOSS_DISK_READ, 0, 0, 1, in),
+                   diskRequest(0, USLOSS_DISK_READ, 0, 15, 2, in),
+                   diskSetPolicy(0, 7));
+
+    memset(out, 'A', USLOSS_DISK_SECTOR_SIZE);
+    memset(out + USLOSS_DISK_SECTOR_SIZE, 'B', USLOSS_DISK_SECTOR_SIZE);
+    result = diskRequest(0, USLOSS_DISK_WRITE, 5, 2, 2, out);
+    USLOSS_Console("start2(): write rc %d\n", result);
+    result = diskRequest(0, USLOSS_DISK_READ, 5, 2, 2, in);
+    USLOSS_Console("start2(): read rc %d, data matches: %d\n", result,
+                   memcmp(in, out, sizeof(out)) == 0);
+    diskStats(0, &seeks, &tracks, &merged);
+    USLOSS_Console("start2(): %d seeks, %d tracks crossed so far\n", seeks, tracks);
+
+    runBatch("FIFO", DISK_FIFO);
+    runBatch("C-LOOK", DISK_CLOOK);
+
+    quit(0);
+    return 0;
+}
+
+int XXp(char *arg)
+{
+    char buf[4 * USLOSS_DISK_SECTOR_SIZE];
+    int  track, sector, count, result;
+
+    sscanf(arg, "%d %d %d", &track, &sector, &count);
+    result = diskRequest(0, USLOSS_DISK_READ, track, sector, count, buf);
+    USLOSS_Console("XXp(): track %2d sectors %2d-%2d done, rc %d\n",
+                   track, sector, sector + count - 1, result);
+
+    quit(0);
+}
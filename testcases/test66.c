@@ -0,0 +1,79 @@
+/* Releases a mailbox while a receiver of higher priority than the
+ * releasing process is blocked on it.  The receiver runs as soon as it is
+ * woken, before MboxRelease returns.  start2 then creates mailboxes until
+ * none are left, and checks that no id was handed out twice.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int Receiver(char *);
+int Releaser(char *);
+
+int mbox_id;
+int ids[MAXMBOX + 1];
+
+
+
+int start2(char *arg)
+{
+    int  kid_status, kidpid, count, dups, i, j;
+
+    USLOSS_Console("start2(): started\n");
+    mbox_id = MboxCreate(1, 50);
+    USLOSS_Console("start2(): MboxCreate returned id = %d\n", mbox_id);
+
+    kidpid = fork1("Receiver", Receiver, NULL, 2 * USLOSS_MIN_STACK, 2);
+    kidpid = fork1("Releaser", Releaser, NULL, 2 * USLOSS_MIN_STACK, 3);
+
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n",
+                   kidpid, kid_status);
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n",
+                   kidpid, kid_status);
+
+    count = 0;
+    while (count <= MAXMBOX && (ids[count] = MboxCreate(0, 0)) >= 0) {
+        count++;
+    }
+    dups = 0;
+    for (i = 0; i < count; i++) {
+        for (j = i + 1; j < count; j++) {
+            if (ids[i] == ids[j]) {
+                dups++;
+            }
+        }
+    }
+    USLOSS_Console("start2(): created %d mailboxes, %d duplicate ids\n",
+                   count, dups);
+
+    quit(0);
+    return 0;
+}
+
+int Receiver(char *arg)
+{
+    char buf[50];
+    int  result;
+
+    USLOSS_Console("Receiver(): receiving from mailbox %d\n", mbox_id);
+    result = MboxRecv(mbox_id, buf, 50);
+    USLOSS_Console("Receiver(): MboxRecv returned %d\n", result);
+
+    quit(3);
+}
+
+int Releaser(char *arg)
+{
+    int  result;
+
+    USLOSS_Console("Releaser(): releasing mailbox %d\n", mbox_id);
+    result = MboxRelease(mbox_id);
+    USLOSS_Console("Releaser(): MboxRelease returned %d\n", result);
+
+    quit(4);
+}
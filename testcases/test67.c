@@ -0,0 +1,64 @@
+/* Releases a mailbox that a lower-priority process is waiting on in
+ * MboxRecvAny.  The waiter is woken but cannot run until start2 blocks,
+ * and start2 first creates mailboxes until none are left.  The released
+ * id must not be handed out before the waiter has seen the release.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int Selector(char *);
+
+int mbox_id;
+
+
+
+int start2(char *arg)
+{
+    int  kid_status, kidpid, count, result;
+
+    USLOSS_Console("start2(): started\n");
+    mbox_id = MboxCreate(1, 50);
+    USLOSS_Console("start2(): MboxCreate returned id = %d\n", mbox_id);
+
+    kidpid = fork1("Selector", Selector, NULL, 2 * USLOSS_MIN_STACK, 4);
+    kernSleep(20000);
+
+    result = MboxRelease(mbox_id);
+    USLOSS_Console("start2(): MboxRelease returned %d\n", result);
+
+    count = 0;
+    while ((result = MboxCreate(0, 0)) >= 0) {
+        if (result == mbox_id) {
+            USLOSS_Console("start2(): id %d handed out again too early\n",
+                           mbox_id);
+        }
+        count++;
+    }
+    USLOSS_Console("start2(): created %d mailboxes\n", count);
+
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n",
+                   kidpid, kid_status);
+
+    quit(0);
+    return 0;
+}
+
+int Selector(char *arg)
+{
+    char buf[50];
+    int  ids[1], which, result;
+
+    ids[0] = mbox_id;
+    which = -1;
+    USLOSS_Console("Selector(): waiting on mailbox %d\n", mbox_id);
+    result = MboxRecvAny(ids, 1, &which, buf, 50);
+    USLOSS_Console("Selector(): MboxRecvAny returned %d, which = %d\n",
+                   result, which);
+
+    quit(3);
+}
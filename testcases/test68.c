@@ -0,0 +1,45 @@
+/* Releases a mailbox while a periodic timer is sending to it.  The release
+ * should stop the timer: kernTimerStop then finds nothing to stop, and the
+ * timer's id is free for the next kernTimerStart.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+
+
+int start2(char *arg)
+{
+    int result, mbox_id, timer_id, tick;
+
+    USLOSS_Console("start2(): started\n");
+
+    mbox_id = MboxCreate(5, sizeof(int));
+    timer_id = kernTimerStart(40000, mbox_id);
+    USLOSS_Console("start2(): kernTimerStart rc %d\n", timer_id);
+
+    result = MboxRecv(mbox_id, &tick, sizeof(int));
+    USLOSS_Console("start2(): MboxRecv rc %d\n", result);
+
+    result = MboxRelease(mbox_id);
+    USLOSS_Console("start2(): MboxRelease rc %d\n", result);
+    result = kernTimerStop(timer_id);
+    USLOSS_Console("start2(): kernTimerStop after release rc %d\n", result);
+
+    kernSleep(100000);
+
+    mbox_id = MboxCreate(5, sizeof(int));
+    timer_id = kernTimerStart(40000, mbox_id);
+    USLOSS_Console("start2(): kernTimerStart on a new mailbox rc %d\n",
+                   timer_id);
+    result = MboxRecv(mbox_id, &tick, sizeof(int));
+    USLOSS_Console("start2(): MboxRecv rc %d\n", result);
+    result = kernTimerStop(timer_id);
+    USLOSS_Console("start2(): kernTimerStop rc %d\n", result);
+
+    quit(0);
+}
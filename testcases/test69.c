@@ -0,0 +1,67 @@
+/* Fills slab classes and checks the counts dumpSlabs reports.  A mailbox
+ * of 4-byte messages carves pages for the 4-byte class; releasing it leaves
+ * the payloads stale on their slots.  A mailbox of full-size messages then
+ * takes every slot, reusing the stale ones, and every page of the pool.
+ * With no slot left MboxCondSend returns -2; after one receive, a 4-byte
+ * message fits in the page the received message gave back.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+
+
+int start2(char *arg)
+{
+    char buf[MAX_MESSAGE];
+    int  small_id, large_id, i, sent, result;
+
+    USLOSS_Console("start2(): started\n");
+    memset(buf, 'x', sizeof(buf));
+
+    small_id = MboxCreate(1100, 4);
+    sent = 0;
+    for (i = 0; i < 1100; i++) {
+        if (MboxCondSend(small_id, buf, 4) == 0) {
+            sent++;
+        }
+    }
+    USLOSS_Console("start2(): sent %d 4-byte messages\n", sent);
+    dumpSlabs();
+    result = MboxRelease(small_id);
+    USLOSS_Console("start2(): MboxRelease rc %d\n", result);
+    dumpSlabs();
+
+    large_id = MboxCreate(MAXSLOTS, MAX_MESSAGE);
+    sent = 0;
+    result = 0;
+    while (result == 0) {
+        result = MboxCondSend(large_id, buf, MAX_MESSAGE);
+        if (result == 0) {
+            sent++;
+        }
+    }
+    USLOSS_Console("start2(): sent %d full-size messages, then rc %d\n",
+                   sent, result);
+    dumpSlabs();
+
+    small_id = MboxCreate(10, 4);
+    result = MboxCondSend(small_id, buf, 4);
+    USLOSS_Console("start2(): MboxCondSend of a 4-byte message rc %d\n",
+                   result);
+    result = MboxRecv(large_id, buf, MAX_MESSAGE);
+    USLOSS_Console("start2(): MboxRecv rc %d\n", result);
+    result = MboxCondSend(small_id, buf, 4);
+    USLOSS_Console("start2(): MboxCondSend after a receive rc %d\n", result);
+    dumpSlabs();
+
+    USLOSS_Console("start2(): MboxRelease rc %d %d\n",
+                   MboxRelease(small_id), MboxRelease(large_id));
+    dumpSlabs();
+
+    quit(0);
+}
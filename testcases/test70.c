@@ -0,0 +1,53 @@
+/* Checks that buffered output keeps a terminal's receive interrupt setting.
+ * With receive interrupts off, a line is written to terminal 1 and flushed
+ * while nobody reads; none of term1.in may arrive, so none of it can
+ * overflow the one-status queue.  Receive interrupts are then turned on
+ * with termRecvInt, another line is written, and the input is read back.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+
+
+int start2(char *arg)
+{
+    int  i, status;
+    char line[MAXLINE + 1], received[9];
+    FILE *file;
+
+    USLOSS_Console("start2(): started\n");
+    USLOSS_Console("start2(): termRecvInt bad unit rc %d\n", termRecvInt(4, 1));
+    waitDeviceDepth(USLOSS_TERM_DEV, 1, 1);
+
+    termWrite(1, "receive interrupts are off\n", 27);
+    termFlush(1);
+    kernSleep(500000);
+    USLOSS_Console("start2(): overflows with receive interrupts off: %d\n",
+                   waitDeviceOverflows(USLOSS_TERM_DEV, 1));
+
+    USLOSS_Console("start2(): termRecvInt rc %d\n", termRecvInt(1, 1));
+    termWrite(1, "receive interrupts are on\n", 26);
+    for (i = 0; i < 8; i++) {
+        waitDeviceRx(1, &status);
+        received[i] = USLOSS_TERM_STAT_CHAR(status);
+        if (received[i] == '\n') {
+            received[i] = '$';
+        }
+    }
+    received[8] = '\0';
+    USLOSS_Console("start2(): received '%s'\n", received);
+    termFlush(1);
+
+    file = fopen("term1.out", "r");
+    while (fgets(line, sizeof(line), file) != NULL) {
+        USLOSS_Console("term1.out: %s", line);
+    }
+    fclose(file);
+
+    quit(0);
+    return 0;
+}
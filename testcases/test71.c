@@ -0,0 +1,63 @@
+/* A subscriber blocks in MboxRecvTopic, and start2, which runs at a higher
+ * priority, publishes to the topic and then releases it before the
+ * subscriber gets to run.  The subscriber must see the release and get -3.
+ * start2 then creates a new topic, which must work normally.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <usloss.h>
+#include <phase1.h>
+#include <phase2.h>
+
+int XXp(char *);
+
+int topic_id, sub_id;
+
+
+
+int start2(char *arg)
+{
+    int  kid_status, kidpid, result;
+    char buf[20];
+
+    USLOSS_Console("start2(): started\n");
+    topic_id = MboxCreateTopic(4, 20, TOPIC_DROP_OLDEST);
+    sub_id = MboxSubscribe(topic_id);
+    USLOSS_Console("start2(): topic %d, subscriber %d\n", topic_id, sub_id);
+
+    kidpid = fork1("XXp", XXp, NULL, 2 * USLOSS_MIN_STACK, 3);
+    kernSleep(20000);
+
+    result = MboxPublish(topic_id, "hello", 6);
+    USLOSS_Console("start2(): MboxPublish rc %d\n", result);
+    result = MboxRelease(topic_id);
+    USLOSS_Console("start2(): MboxRelease rc %d\n", result);
+
+    kidpid = join(&kid_status);
+    USLOSS_Console("start2(): joined with kid %d, status = %d\n",
+                   kidpid, kid_status);
+
+    topic_id = MboxCreateTopic(4, 20, TOPIC_DROP_OLDEST);
+    sub_id = MboxSubscribe(topic_id);
+    result = MboxPublish(topic_id, "again", 6);
+    USLOSS_Console("start2(): new topic %d, MboxPublish rc %d\n",
+                   topic_id, result);
+    result = MboxRecvTopic(topic_id, sub_id, buf, 20);
+    USLOSS_Console("start2(): MboxRecvTopic rc %d '%s'\n", result, buf);
+
+    quit(0);
+    return 0;
+}
+
+int XXp(char *arg)
+{
+    char buf[20];
+    int  result;
+
+    USLOSS_Console("XXp(): waiting on topic %d\n", topic_id);
+    result = MboxRecvTopic(topic_id, sub_id, buf, 20);
+    USLOSS_Console("XXp(): MboxRecvTopic rc %d\n", result);
+
+    quit(3);
+}